@@ -324,89 +324,75 @@ int hassession_byname(request_rec *r, int nodeid, const char *route, const proxy
     return 0;
 }
 
+/*
+ * Check that the context is one of a virtual host of the node matching the hostname
+ */
+static int context_host_matches(const contextinfo_t *context, const char *hostname,
+                                const proxy_vhost_table *vhost_table)
+{
+    int i;
+    for (i = 0; i < vhost_table->sizevhost; i++) {
+        hostinfo_t *vhost = vhost_table->vhost_info + i;
+        if (context->vhost == vhost->vhost && context->node == vhost->node && strcmp(hostname, vhost->host) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
 node_context *find_node_context_host(request_rec *r, const proxy_balancer *balancer, const char *route, int use_alias,
                                      const proxy_vhost_table *vhost_table, const proxy_context_table *context_table,
                                      const proxy_node_table *node_table, int *has_contexts)
 {
     int sizecontext = context_table->sizecontext;
-    int *contexts;
-    int *length;
-    int *status;
-    int i, j, max;
+    int j, max;
     node_context *best;
     int nbest;
-    const char *uri = NULL;
-    const char *luri = r->uri;
+    const char *uri = r->uri;
+    apr_size_t urilen;
+    const char *hostname = NULL;
 
     if (apr_table_get(r->notes, "proxy-context")) {
         return (node_context *)apr_table_get(r->notes, "proxy-context");
     }
 
-    uri = ap_strchr_c(luri, '?');
-    if (uri) {
-        uri = apr_pstrndup(r->pool, luri, uri - luri);
+    /* compare only the path (without the query string or the path parameters) */
+    if (ap_strchr_c(uri, '?')) {
+        urilen = ap_strchr_c(uri, '?') - uri;
     } else {
-        uri = ap_strchr_c(luri, ';');
-        uri = uri ? apr_pstrndup(r->pool, luri, uri - luri) : luri;
+        urilen = strcspn(uri, ";");
     }
 
     /* read the contexts */
     if (sizecontext == 0) {
         return NULL;
     }
-    contexts = apr_palloc(r->pool, sizeof(int) * sizecontext);
-    for (i = 0; i < sizecontext; i++) {
-        contexts[i] = i;
-    }
-    length = apr_pcalloc(r->pool, sizeof(int) * (unsigned)sizecontext);
-    status = apr_palloc(r->pool, sizeof(int) * sizecontext);
     /* Check the virtual host */
     if (use_alias) {
-        /* read the hosts */
-        int sizevhost;
-        int *contextsok = apr_pcalloc(r->pool, sizeof(int) * sizecontext);
-        const char *hostname = ap_get_server_name(r);
+        hostname = ap_get_server_name(r);
         ap_log_error(APLOG_MARK, APLOG_TRACE4, 0, r->server, "find_node_context_host: Host: %s", hostname);
-        sizevhost = vhost_table->sizevhost;
-        for (i = 0; i < sizevhost; i++) {
-            hostinfo_t *vhost = vhost_table->vhost_info + i;
-            if (strcmp(hostname, vhost->host) == 0) {
-                /* add the contexts that match */
-                for (j = 0; j < sizecontext; j++) {
-                    contextinfo_t *context = &context_table->context_info[j];
-                    if (context->vhost == vhost->vhost && context->node == vhost->node) {
-                        contextsok[j] = 1;
-                    }
-                }
-            }
-        }
-        for (j = 0; j < sizecontext; j++) {
-            if (!contextsok[j]) {
-                contexts[j] = -1;
-            }
-        }
-    }
-#if HAVE_CLUSTER_EX_DEBUG
-    for (j = 0; j < sizecontext; j++) {
-        contextinfo_t *context;
-        if (contexts[j] == -1) {
-            continue;
-        }
-        context = &context_table->context_info[j];
-        ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, r->server, "find_node_context_host: %s node: %d vhost: %d context: %s",
-                     uri, context->node, context->vhost, context->context);
     }
-#endif
 
-    /* Check the contexts */
+    /*
+     * Check the contexts in one pass, best keeps the usable contexts of the longest match found so far,
+     * it is the only allocation and is saved in the notes for the other lookups of the request.
+     */
+    best = apr_palloc(r->pool, sizeof(node_context) * (sizecontext + 1));
+    nbest = 0;
     max = 0;
     for (j = 0; j < sizecontext; j++) {
-        contextinfo_t *context;
-        int len;
-        if (contexts[j] == -1) {
+        contextinfo_t *context = &context_table->context_info[j];
+        apr_size_t len;
+        int ok = 0;
+
+        if (hostname && !context_host_matches(context, hostname, vhost_table)) {
             continue;
         }
-        context = &context_table->context_info[j];
+#if HAVE_CLUSTER_EX_DEBUG
+        ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, r->server,
+                     "find_node_context_host: %.*s node: %d vhost: %d context: %s", (int)urilen, uri, context->node,
+                     context->vhost, context->context);
+#endif
 
         /* keep only the contexts corresponding to our balancer */
         if (balancer != NULL) {
@@ -422,53 +408,34 @@ node_context *find_node_context_host(request_rec *r, const proxy_balancer *balan
         }
         *has_contexts = -1;
         len = strlen(context->context);
-        if (strncmp(uri, context->context, len) == 0) {
-            if (uri[len] == '\0' || uri[len] == '/' || len == 1) {
-                status[j] = context->status;
-                length[j] = len;
-                if (len > max) {
-                    max = len;
-                }
-            }
+        if (len == 0 || (int)len < max || len > urilen || strncmp(uri, context->context, len) != 0) {
+            continue;
         }
-    }
-
-    if (max == 0) {
-        return NULL;
-    }
-
-    /* find the best matching contexts */
-    nbest = 1;
-    for (j = 0; j < sizecontext; j++) {
-        if (length[j] == max) {
-            nbest++;
+        if (len != urilen && uri[len] != '/' && len != 1) {
+            continue;
+        }
+        if ((int)len > max) {
+            /* longer match: forget the previous ones */
+            max = (int)len;
+            nbest = 0;
         }
-    }
 
-    best = apr_palloc(r->pool, sizeof(node_context) * nbest);
-    nbest = 0;
-    for (j = 0; j < sizecontext; j++) {
-        if (length[j] == max) {
-            contextinfo_t *context;
-            int ok = 0;
-            context = &context_table->context_info[j];
-            /* Check status */
-            switch (status[j]) {
-            case ENABLED:
+        /* Check status */
+        switch (context->status) {
+        case ENABLED:
+            ok = 1;
+            break;
+        case DISABLED:
+            /* Only the request with sessionid ok for it */
+            if (hassession_byname(r, context->node, route, node_table)) {
                 ok = 1;
-                break;
-            case DISABLED:
-                /* Only the request with sessionid ok for it */
-                if (hassession_byname(r, context->node, route, node_table)) {
-                    ok = 1;
-                }
-                break;
-            }
-            if (ok) {
-                best[nbest].node = context->node;
-                best[nbest].context = context->id;
-                nbest++;
             }
+            break;
+        }
+        if (ok) {
+            best[nbest].node = context->node;
+            best[nbest].context = context->id;
+            nbest++;
         }
     }
 
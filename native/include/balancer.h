@@ -40,6 +40,7 @@ struct balancerinfo
     int StickySessionForce;  /* 0: Don't force, 1: return error */
     int Timeout;
     int Maxattempts;
+    int SlowStart; /* seconds to ramp up the load factor of new or re-enabled nodes, 0: no ramp */
 
     apr_time_t updatetime; /* time of last received message */
 };
@@ -45,6 +45,9 @@ struct contextinfo
     int node;                    /* id of the correspond node in nodes table */
     int status;                  /* status: ENABLED/DISABLED/STOPPED */
     int nbrequests;              /* number of request been processed */
+    int nbqueued;                /* number of requests waiting for the context */
+    int nbwaited;                /* number of requests that have waited */
+    apr_time_t waittime;         /* total time spent waiting */
 
     apr_time_t updatetime; /* time of last received message */
 };
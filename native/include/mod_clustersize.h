@@ -30,6 +30,7 @@ typedef struct ap_slotmem_provider_t slotmem_storage_method;
 #define BALANCERSZ  40
 #define JVMROUTESZ  PROXY_WORKER_MAX_ROUTE_SIZE
 #define DOMAINNDSZ  20
+#define LOCALITYSZ  20
 #define HOSTNODESZ  64
 #define PORTNODESZ  7
 #define SCHEMENDSZ  16
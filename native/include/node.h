@@ -25,6 +25,9 @@ typedef struct mem mem_t;
 
 #include "mod_clustersize.h"
 
+/* Metrics a node can report in STATUS besides Load: Cpu, Heap, Queue and Threads usage in percent */
+#define LOAD_METRICS 4
+
 /**
  * Configuration of the node received from jboss cluster
  */
@@ -37,6 +40,9 @@ struct nodemess
     char balancer[BALANCERSZ]; /* name of the balancer */
     char JVMRoute[JVMROUTESZ];
     char Domain[DOMAINNDSZ];
+    char Region[LOCALITYSZ]; /* locality of the node, from the broadest level to the narrowest */
+    char Zone[LOCALITYSZ];
+    char Rack[LOCALITYSZ];
     char Host[HOSTNODESZ];
     char Port[PORTNODESZ];
     char Type[SCHEMENDSZ];
@@ -54,6 +60,7 @@ struct nodemess
     int smax;
     apr_time_t ttl;
     apr_time_t timeout;
+    apr_time_t slowstart; /* slow-start window of the balancer */
 
     /* part updated in httpd */
     apr_time_t updatetimelb; /* time of last update of the lbstatus value */
@@ -62,6 +69,30 @@ struct nodemess
     apr_off_t oldread;       /* Number of bytes read from remote when calculating the lbstatus */
     apr_time_t lastcleantry; /* time of last unsuccessful try to clean the worker in proxy part */
     int num_remove_check;    /* number of tries to remove a REMOVED node */
+    apr_time_t rampstart;    /* time the node was added or re-enabled (start of the slow-start ramp) */
+    apr_time_t outlierstart; /* start of the current window of the outlier detection */
+    int outlierrequests[2];  /* requests in the current [0] and previous [1] windows */
+    int outlierfailures[2];  /* failed requests in the current [0] and previous [1] windows */
+    int consecutivefailures; /* failed requests since the last successful one */
+    int ejections;           /* number of consecutive ejections (the ejection time doubles each time) */
+    apr_time_t ejecteduntil; /* the outlier detection ejected the node until that time */
+    apr_time_t probetime;    /* time of the last ping/pong for STATUS */
+    int probeok;             /* result of that ping/pong */
+
+    /* load metrics of the last STATUS */
+    int metrics[LOAD_METRICS]; /* usage in percent */
+    unsigned metricsmask;      /* the metrics (bits) the STATUS reported */
+
+    /* part updated in httpd without lock */
+    apr_uint32_t ewma_time;   /* EWMA of the response time in microseconds */
+    apr_uint32_t ewma_stamp;  /* time (in milliseconds, wrapping) of the last sample of ewma_time */
+    apr_uint32_t ewma_avg;    /* EWMA (not peak) of the response time in microseconds */
+    apr_uint32_t ewma_errors; /* EWMA of the error rate in parts per million */
+    apr_uint32_t circuit;     /* circuit breaker state: closed, open or half-open */
+    apr_uint32_t trials;      /* trial requests admitted in the half-open state */
+    apr_uint32_t successes;   /* successful trial requests in the half-open state */
+    apr_uint32_t halfopen;    /* time (in seconds) the circuit moved to half-open */
+    apr_uint32_t probing;     /* a background ping/pong for STATUS is in flight */
 };
 typedef struct nodemess nodemess_t;
 
@@ -57,7 +57,8 @@ static apr_status_t update(void *mem, void *data, apr_pool_t *pool)
     (void)pool;
 
     if (strcmp(in->context, ou->context) == 0 && in->vhost == ou->vhost && in->node == ou->node) {
-        /* We don't update nbrequests it belongs to mod_proxy_cluster logic */
+        /* We don't update nbrequests and the queue stats they belong to mod_proxy_cluster logic */
+        in->id = ou->id;
         ou->status = in->status;
         ou->updatetime = apr_time_sec(apr_time_now());
         return APR_EEXIST; /* it exists so we are done */
@@ -87,7 +88,11 @@ apr_status_t insert_update_context(mem_t *s, contextinfo_t *context)
     }
     memcpy(ou, context, sizeof(contextinfo_t));
     ou->id = id;
+    context->id = id;
     ou->nbrequests = 0;
+    ou->nbqueued = 0;
+    ou->nbwaited = 0;
+    ou->waittime = 0;
     ou->updatetime = apr_time_sec(apr_time_now());
 
     return APR_SUCCESS;
@@ -81,6 +81,7 @@ apr_status_t insert_update_host(mem_t *s, hostinfo_t *host)
     }
     memcpy(ou, host, sizeof(hostinfo_t));
     ou->id = id;
+    host->id = id;
     ou->updatetime = apr_time_sec(apr_time_now());
 
     return APR_SUCCESS;
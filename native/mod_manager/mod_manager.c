@@ -10,6 +10,8 @@
 #include "domain.h"
 #include "common.h"
 
+#include "apr_atomic.h"
+#include "apr_hash.h"
 #include "apr_lib.h"
 #include "apr_uuid.h"
 
@@ -36,6 +38,7 @@
 #define SROUBIG                "SYNTAX: JVMRoute field too big"
 #define SROUBAD                "SYNTAX: JVMRoute can't be empty"
 #define SDOMBIG                "SYNTAX: LBGroup field too big"
+#define SLOCBIG                "SYNTAX: Region, Zone or Rack field too big"
 #define SHOSBIG                "SYNTAX: Host field too big"
 #define SPORBIG                "SYNTAX: Port field too big"
 #define STYPBIG                "SYNTAX: Type field too big"
@@ -45,6 +48,8 @@
 #define SPNGBAD                "SYNTAX: Ping field has bad value"
 #define STTLBAD                "SYNTAX: TTL field has bad value"
 #define STIMBAD                "SYNTAX: Timeout field has bad value"
+#define SSLOBAD                "SYNTAX: SlowStart field has bad value"
+#define SMETBAD                "SYNTAX: %s field has bad value"
 #define SALIBAD                "SYNTAX: Alias without Context"
 #define SCONBAD                "SYNTAX: Context without Alias"
 #define NOCONAL                "SYNTAX: No Context and Alias in APP command"
@@ -54,6 +59,8 @@
 #define SMULALB                "SYNTAX: Only one Alias in APP command"
 #define SMULCTB                "SYNTAX: Only one Context in APP command"
 #define SREADER                "SYNTAX: %s can't read POST data"
+#define SBATCMD                "SYNTAX: Invalid Command \"%s\" in BATCH-APP"
+#define SBATNOC                "SYNTAX: Alias or Context without Command in BATCH-APP"
 
 #define TYPEMEM                2
 #define MNODEUI                "MEM: Can't update or insert node with \"%s\" JVMRoute"
@@ -66,7 +73,7 @@
 #define MNODEET                "MEM: Another for the same worker already exist"
 
 /* Protocol version supported */
-#define VERSION_PROTOCOL       "0.2.1"
+#define VERSION_PROTOCOL       "0.2.3"
 
 /* Internal substitution for node commands */
 #define NODE_COMMAND           "/NODE_COMMAND"
@@ -83,10 +90,15 @@
 #define PLAINTEXT_CONTENT_TYPE "text/plain"
 #define XML_CONTENT_TYPE       "text/xml"
 
+/* Names of the load metrics in STATUS */
+static const char *const load_metrics[LOAD_METRICS] = {"Cpu", "Heap", "Queue", "Threads"};
+
 /* Data structure for shared memory block */
 typedef struct version_data
 {
     apr_uint64_t counter;
+    apr_uint32_t generation; /* changes of the tables displayed by INFO and DUMP */
+    apr_time_t changed;      /* time of the last increase of the counter */
 } version_data;
 
 /* mutex and lock for tables/slotmen */
@@ -98,6 +110,19 @@ static const char *context_mutex_type = "context-shm";
 /* counter for the version (nodes) */
 static ap_slotmem_instance_t *version_node_mem = NULL;
 
+/* Index of the hosts and contexts of each node, in shared memory */
+typedef struct node_index
+{
+    volatile apr_uint32_t gen; /* odd while the index is changed (under the nodes lock) */
+    int nbhost;
+    int nbcontext;
+    int ids[]; /* ids of the hosts (maxhost entries) followed by the ids of the contexts (maxcontext entries) */
+} node_index_t;
+
+static ap_slotmem_instance_t *node_index_mem = NULL;
+static int node_index_maxhost = 0;
+static int node_index_maxcontext = 0;
+
 /* shared memory */
 static mem_t *contextstatsmem = NULL;
 static mem_t *nodestatsmem = NULL;
@@ -138,6 +163,8 @@ typedef struct mod_manager_config
 
     /* version, the version is increased each time the node update logic is called */
     unsigned tableversion;
+    /* time of the last update of the workers to tableversion */
+    apr_time_t tableupdated;
 
     /* Should be the slotmem persisted (1) or not (0) */
     int persistent;
@@ -166,6 +193,12 @@ typedef struct mod_manager_config
     char *ajp_secret;
     /* size of the proxy response field buffer */
     long response_field_size;
+    /* default slow-start window of the balancers in seconds */
+    int slow_start;
+    /* time during which the changes of the nodes are combined before the workers are updated */
+    apr_interval_time_t coalesce_time;
+    /* weights of the load metrics of STATUS (-1: not configured) */
+    int metric_weights[LOAD_METRICS];
 
 } mod_manager_config;
 
@@ -185,9 +218,193 @@ static int loc_get_max_size_node(void)
     return nodestatsmem ? get_max_size_node(nodestatsmem) : 0;
 }
 
+#define NODE_INDEX_RETRIES 100 /* reads of a changing index before falling back to the table scan */
+
+static node_index_t *get_node_index(int node)
+{
+    node_index_t *index;
+    if (node_index_mem == NULL || node < 0 || storage->dptr(node_index_mem, node, (void **)&index) != APR_SUCCESS) {
+        return NULL;
+    }
+    return index;
+}
+
+/*
+ * The ids are kept sorted so that the node-scoped walks see the slots in the same order as get_ids_used_*()
+ */
+static void index_add(int *ids, int *nb, int max, int id)
+{
+    int i = 0;
+    while (i < *nb && ids[i] < id) {
+        i++;
+    }
+    if ((i < *nb && ids[i] == id) || *nb >= max) {
+        return;
+    }
+    memmove(ids + i + 1, ids + i, sizeof(int) * (*nb - i));
+    ids[i] = id;
+    (*nb)++;
+}
+
+static void index_remove(int *ids, int *nb, int id)
+{
+    int i;
+    for (i = 0; i < *nb; i++) {
+        if (ids[i] == id) {
+            (*nb)--;
+            memmove(ids + i, ids + i + 1, sizeof(int) * (*nb - i));
+            return;
+        }
+    }
+}
+
+/*
+ * Add (or remove) a host to the index of its node, the nodes must be locked
+ */
+static void index_host(int node, int id, int add)
+{
+    node_index_t *index = get_node_index(node);
+    if (index == NULL) {
+        return;
+    }
+    apr_atomic_inc32(&index->gen);
+    if (add) {
+        index_add(index->ids, &index->nbhost, node_index_maxhost, id);
+    } else {
+        index_remove(index->ids, &index->nbhost, id);
+    }
+    apr_atomic_inc32(&index->gen);
+}
+
+/*
+ * Add (or remove) a context to the index of its node, the nodes must be locked
+ */
+static void index_context(int node, int id, int add)
+{
+    node_index_t *index = get_node_index(node);
+    if (index == NULL) {
+        return;
+    }
+    apr_atomic_inc32(&index->gen);
+    if (add) {
+        index_add(index->ids + node_index_maxhost, &index->nbcontext, node_index_maxcontext, id);
+    } else {
+        index_remove(index->ids + node_index_maxhost, &index->nbcontext, id);
+    }
+    apr_atomic_inc32(&index->gen);
+}
+
+/*
+ * Copy the host (or context) ids of the index without the nodes lock: retry when a writer changed it
+ * meanwhile (gen odd or different after the copy). Return -1 if it keeps changing.
+ */
+static int read_node_index(const node_index_t *index, int hosts, int *ids)
+{
+    int retries, nb;
+    int max = hosts ? node_index_maxhost : node_index_maxcontext;
+    const int *src = hosts ? index->ids : index->ids + node_index_maxhost;
+
+    for (retries = 0; retries < NODE_INDEX_RETRIES; retries++) {
+        apr_uint32_t gen = apr_atomic_read32(&index->gen);
+        if (gen & 1) {
+            continue;
+        }
+        nb = hosts ? index->nbhost : index->nbcontext;
+        if (nb < 0 || nb > max) {
+            continue;
+        }
+        memcpy(ids, src, sizeof(int) * nb);
+        if (apr_atomic_read32(&index->gen) == gen) {
+            return nb;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Copy the ids of the hosts of a node, like get_ids_used_host() ids must have room for all the hosts.
+ * The callers still check the node of each host: the host may be removed once the index is read.
+ */
+static int get_node_host_ids(int node, int *ids)
+{
+    node_index_t *index = get_node_index(node);
+    int nb = index != NULL ? read_node_index(index, 1, ids) : -1;
+    if (nb == -1) {
+        return get_ids_used_host(hoststatsmem, ids);
+    }
+    return nb;
+}
+
+/*
+ * Copy the ids of the contexts of a node, like get_ids_used_context() ids must have room for all the contexts
+ */
+static int get_node_context_ids(int node, int *ids)
+{
+    node_index_t *index = get_node_index(node);
+    int nb = index != NULL ? read_node_index(index, 0, ids) : -1;
+    if (nb == -1) {
+        return get_ids_used_context(contextstatsmem, ids);
+    }
+    return nb;
+}
+
+/*
+ * Fill the index from the host and context tables
+ */
+static void build_node_index(apr_pool_t *pool)
+{
+    int size, i;
+    int *id;
+
+    size = get_max_size_node(nodestatsmem);
+    for (i = 0; i < size; i++) {
+        node_index_t *index = get_node_index(i);
+        if (index != NULL) {
+            apr_atomic_set32(&index->gen, 0);
+            index->nbhost = 0;
+            index->nbcontext = 0;
+        }
+    }
+
+    id = apr_palloc(pool, sizeof(int) * get_max_size_host(hoststatsmem));
+    size = get_ids_used_host(hoststatsmem, id);
+    for (i = 0; i < size; i++) {
+        hostinfo_t *ou;
+        if (get_host(hoststatsmem, &ou, id[i]) == APR_SUCCESS) {
+            index_host(ou->node, ou->id, 1);
+        }
+    }
+
+    id = apr_palloc(pool, sizeof(int) * get_max_size_context(contextstatsmem));
+    size = get_ids_used_context(contextstatsmem, id);
+    for (i = 0; i < size; i++) {
+        contextinfo_t *ou;
+        if (get_context(contextstatsmem, &ou, id[i]) == APR_SUCCESS) {
+            index_context(ou->node, ou->id, 1);
+        }
+    }
+}
+
+static void remove_node_host(const hostinfo_t *host)
+{
+    int node = host->node, id = host->id;
+    remove_host(hoststatsmem, id);
+    index_host(node, id, 0);
+}
+
+static void remove_node_context(const contextinfo_t *context)
+{
+    int node = context->node, id = context->id;
+    remove_context(contextstatsmem, id);
+    index_context(node, id, 0);
+}
+
+static void inc_generation(void);
 static apr_status_t loc_remove_node(int id)
 {
-    return remove_node(nodestatsmem, id);
+    apr_status_t rv = remove_node(nodestatsmem, id);
+    inc_generation();
+    return rv;
 }
 
 static apr_status_t loc_find_node(nodeinfo_t **node, const char *route)
@@ -203,6 +420,7 @@ static void inc_version_node(void)
     version_data *base;
     if (storage->dptr(version_node_mem, 0, (void **)&base) == APR_SUCCESS) {
         base->counter++;
+        base->changed = apr_time_now();
     }
 }
 static apr_uint64_t get_version_node(void)
@@ -213,6 +431,14 @@ static apr_uint64_t get_version_node(void)
     }
     return 0;
 }
+static apr_time_t get_version_node_changed(void)
+{
+    version_data *base;
+    if (storage->dptr(version_node_mem, 0, (void **)&base) == APR_SUCCESS) {
+        return base->changed;
+    }
+    return 0;
+}
 static void set_version_node(apr_uint64_t val)
 {
     version_data *base;
@@ -221,9 +447,30 @@ static void set_version_node(apr_uint64_t val)
     }
 }
 
+/**
+ * Increase the generation of the tables, it must be called once the change is done
+ */
+static void inc_generation(void)
+{
+    version_data *base;
+    if (storage->dptr(version_node_mem, 0, (void **)&base) == APR_SUCCESS) {
+        apr_atomic_inc32(&base->generation);
+    }
+}
+static apr_uint32_t get_generation(void)
+{
+    version_data *base;
+    if (storage->dptr(version_node_mem, 0, (void **)&base) == APR_SUCCESS) {
+        return apr_atomic_read32(&base->generation);
+    }
+    return 0;
+}
+
 /**
  * Check is the nodes (in shared memory) were modified since last
  * call to worker_nodes_are_updated().
+ * With UpdateCoalesceTime the update waits while the nodes are still changing (a registration storm),
+ * so several changes are applied at once, but not longer than UpdateCoalesceTime after the last update.
  *
  * @param data server_rec
  * @param pool unused argument
@@ -245,6 +492,13 @@ static unsigned loc_worker_nodes_need_update(void *data, apr_pool_t *pool)
     last = get_version_node();
 
     if (last != mconf->tableversion) {
+        if (mconf->coalesce_time && mconf->tableversion) {
+            apr_time_t now = apr_time_now();
+            if (now - get_version_node_changed() < mconf->coalesce_time &&
+                now - mconf->tableupdated < mconf->coalesce_time) {
+                return 0;
+            }
+        }
         return last;
     }
     return 0;
@@ -258,6 +512,7 @@ static int loc_worker_nodes_are_updated(void *data, unsigned last)
     server_rec *s = (server_rec *)data;
     mod_manager_config *mconf = ap_get_module_config(s->module_config, &manager_module);
     mconf->tableversion = last;
+    mconf->tableupdated = apr_time_now();
     return 0;
 }
 
@@ -298,7 +553,7 @@ static void loc_remove_host_context(int node, apr_pool_t *pool)
     }
     id = apr_palloc(pool, sizeof(int) * size);
     idcontext = apr_palloc(pool, sizeof(int) * sizecontext);
-    size = get_ids_used_host(hoststatsmem, id);
+    size = get_node_host_ids(node, id);
     for (i = 0; i < size; i++) {
         hostinfo_t *ou;
 
@@ -306,20 +561,21 @@ static void loc_remove_host_context(int node, apr_pool_t *pool)
             continue;
         }
         if (ou->node == node) {
-            remove_host(hoststatsmem, ou->id);
+            remove_node_host(ou);
         }
     }
 
-    sizecontext = get_ids_used_context(contextstatsmem, idcontext);
+    sizecontext = get_node_context_ids(node, idcontext);
     for (i = 0; i < sizecontext; i++) {
         contextinfo_t *context;
         if (get_context(contextstatsmem, &context, idcontext[i]) != APR_SUCCESS) {
             continue;
         }
         if (context->node == node) {
-            remove_context(contextstatsmem, context->id);
+            remove_node_context(context);
         }
     }
+    inc_generation();
 }
 
 static const struct node_storage_method node_storage = {
@@ -501,6 +757,7 @@ static apr_status_t cleanup_manager(void *param)
     sessionidstatsmem = NULL;
     domainstatsmem = NULL;
     version_node_mem = NULL;
+    node_index_mem = NULL;
     (void)param;
     return APR_SUCCESS;
 }
@@ -554,6 +811,7 @@ static int manager_init(apr_pool_t *p, apr_pool_t *plog, apr_pool_t *ptemp, serv
     char *sessionid;
     char *domain;
     char *version;
+    char *nodeindex;
     apr_uuid_t uuid;
     mod_manager_config *mconf = ap_get_module_config(s->module_config, &manager_module);
     apr_status_t rv;
@@ -571,6 +829,7 @@ static int manager_init(apr_pool_t *p, apr_pool_t *plog, apr_pool_t *ptemp, serv
         sessionid = apr_pstrcat(ptemp, mconf->basefilename, "/manager.sessionid", NULL);
         domain = apr_pstrcat(ptemp, mconf->basefilename, "/manager.domain", NULL);
         version = apr_pstrcat(ptemp, mconf->basefilename, "/manager.version", NULL);
+        nodeindex = apr_pstrcat(ptemp, mconf->basefilename, "/manager.nodeindex", NULL);
     } else {
         node = ap_server_root_relative(ptemp, "logs/manager.node");
         context = ap_server_root_relative(ptemp, "logs/manager.context");
@@ -579,6 +838,7 @@ static int manager_init(apr_pool_t *p, apr_pool_t *plog, apr_pool_t *ptemp, serv
         sessionid = ap_server_root_relative(ptemp, "logs/manager.sessionid");
         domain = ap_server_root_relative(ptemp, "logs/manager.domain");
         version = ap_server_root_relative(ptemp, "logs/manager.version");
+        nodeindex = ap_server_root_relative(ptemp, "logs/manager.nodeindex");
     }
 
     /* Do some sanity checks */
@@ -649,14 +909,26 @@ static int manager_init(apr_pool_t *p, apr_pool_t *plog, apr_pool_t *ptemp, serv
         return !OK;
     }
 
-    /* For the version node we just need a apr_uint64_t in shared memory */
-    rv = storage->create(&version_node_mem, version, sizeof(apr_uint64_t), 1, AP_SLOTMEM_TYPE_PREGRAB, p);
+    /* For the version node we just need a version_data in shared memory */
+    rv = storage->create(&version_node_mem, version, sizeof(version_data), 1, AP_SLOTMEM_TYPE_PREGRAB, p);
     if (rv != APR_SUCCESS) {
         ap_log_error(APLOG_MARK, APLOG_EMERG, rv, s, "manager_init: create_share_version failed");
         return !OK;
     }
     set_version_node(0);
 
+    /* The index of the hosts and contexts of each node, rebuilt from the (maybe persisted) tables */
+    node_index_maxhost = mconf->maxhost;
+    node_index_maxcontext = mconf->maxcontext;
+    rv = storage->create(&node_index_mem, nodeindex,
+                         sizeof(node_index_t) + sizeof(int) * (node_index_maxhost + node_index_maxcontext),
+                         mconf->maxnode, AP_SLOTMEM_TYPE_PREGRAB, p);
+    if (rv != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_EMERG, rv, s, "manager_init: create node index failed");
+        return !OK;
+    }
+    build_node_index(ptemp);
+
     /* Get a provider to ping/pong logics */
     balancerhandler = ap_lookup_provider("proxy_cluster", "balancer", "0");
     if (balancerhandler == NULL) {
@@ -686,48 +958,17 @@ static int manager_init(apr_pool_t *p, apr_pool_t *plog, apr_pool_t *ptemp, serv
     return OK;
 }
 
-static apr_status_t decodeenc(char **ptr);
-static char **process_buff(request_rec *r, char *buff)
-{
-    int i = 0;
-    char *s = buff;
-    char **ptr = NULL;
-    for (; *s != '\0'; s++) {
-        if (*s == '&' || *s == '=') {
-            i++;
-        }
-    }
-    ptr = apr_palloc(r->pool, sizeof(char *) * (i + 2));
-    if (ptr == NULL) {
-        return NULL;
-    }
-
-    s = buff;
-    ptr[0] = s;
-    ptr[i + 1] = NULL;
-    i = 1;
-    for (; *s != '\0'; s++) {
-        /* our separators */
-        if (*s == '&' || *s == '=') {
-            *s = '\0';
-            ptr[i] = s + 1;
-            i++;
-        }
-    }
-
-    if (decodeenc(ptr) != APR_SUCCESS) {
-        return NULL;
-    }
-
-    return ptr;
-}
-
 static apr_status_t insert_update_host_helper(server_rec *s, mem_t *mem, hostinfo_t *info, char *alias)
 {
+    apr_status_t rv;
     (void)s;
     strncpy(info->host, alias, HOSTALIASZ);
     info->host[HOSTALIASZ] = '\0';
-    return insert_update_host(mem, info);
+    rv = insert_update_host(mem, info);
+    if (rv == APR_SUCCESS) {
+        index_host(info->node, info->id, 1);
+    }
+    return rv;
 }
 
 /**
@@ -739,13 +980,16 @@ static void read_remove_context(mem_t *mem, contextinfo_t *context)
     contextinfo_t *info;
     info = read_context(mem, context);
     if (info != NULL) {
-        remove_context(mem, info->id);
+        int node = info->node, id = info->id;
+        remove_context(mem, id);
+        index_context(node, id, 0);
     }
 }
 
 static apr_status_t insert_update_context_helper(server_rec *s, mem_t *mem, contextinfo_t *info, char *context,
                                                  int status)
 {
+    apr_status_t rv;
     (void)s;
     info->id = 0;
     strncpy(info->context, context, CONTEXTSZ);
@@ -755,7 +999,11 @@ static apr_status_t insert_update_context_helper(server_rec *s, mem_t *mem, cont
         return APR_SUCCESS;
     }
 
-    return insert_update_context(mem, info);
+    rv = insert_update_context(mem, info);
+    if (rv == APR_SUCCESS) {
+        index_context(info->node, info->id, 1);
+    }
+    return rv;
 }
 
 
@@ -792,6 +1040,105 @@ static int is_same_node(const nodeinfo_t *nodeinfo, const nodeinfo_t *node)
     return 1;
 }
 
+/*
+ * Check that the configuration of a node is the stored one, the fields updated by httpd are ignored
+ */
+static int is_same_node_config(const nodemess_t *ou, const nodemess_t *in)
+{
+    if (ou->remove || strcmp(ou->JVMRoute, in->JVMRoute) || strcmp(ou->balancer, in->balancer)) {
+        return 0;
+    }
+    if (strcmp(ou->Domain, in->Domain)) {
+        return 0;
+    }
+    if (strcmp(ou->Region, in->Region) || strcmp(ou->Zone, in->Zone) || strcmp(ou->Rack, in->Rack)) {
+        return 0;
+    }
+    if (strcmp(ou->Host, in->Host) || strcmp(ou->Port, in->Port) || strcmp(ou->Type, in->Type)) {
+        return 0;
+    }
+    if (strcmp(ou->Upgrade, in->Upgrade) || strcmp(ou->AJPSecret, in->AJPSecret)) {
+        return 0;
+    }
+    if (ou->reversed != in->reversed || ou->ResponseFieldSize != in->ResponseFieldSize) {
+        return 0;
+    }
+    if (ou->flushpackets != in->flushpackets || ou->flushwait != in->flushwait || ou->ping != in->ping) {
+        return 0;
+    }
+    if (ou->smax != in->smax || ou->ttl != in->ttl || ou->timeout != in->timeout || ou->slowstart != in->slowstart) {
+        return 0;
+    }
+    return 1;
+}
+
+static int is_same_balancer_config(const balancerinfo_t *ou, const balancerinfo_t *in)
+{
+    if (ou->StickySession != in->StickySession || strcmp(ou->StickySessionCookie, in->StickySessionCookie)) {
+        return 0;
+    }
+    if (strcmp(ou->StickySessionPath, in->StickySessionPath) || ou->StickySessionRemove != in->StickySessionRemove) {
+        return 0;
+    }
+    if (ou->StickySessionForce != in->StickySessionForce || ou->Timeout != in->Timeout) {
+        return 0;
+    }
+    return ou->Maxattempts == in->Maxattempts && ou->SlowStart == in->SlowStart;
+}
+
+/*
+ * Check that the hosts and contexts of the node are the ones a CONFIG would insert:
+ * alias i in vhost i + 1 and every context STOPPED in every vhost, none without Alias.
+ */
+static int is_same_hosts_contexts(const request_rec *r, int node, const apr_array_header_t *aliases,
+                                  const apr_array_header_t *contexts)
+{
+    int size, i, j, count = 0;
+    int *id;
+
+    size = loc_get_max_size_host();
+    id = apr_palloc(r->pool, sizeof(int) * size);
+    size = get_node_host_ids(node, id);
+    for (i = 0; i < size; i++) {
+        hostinfo_t *ou;
+        if (get_host(hoststatsmem, &ou, id[i]) != APR_SUCCESS || ou->node != node) {
+            continue;
+        }
+        if (ou->vhost < 1 || ou->vhost > aliases->nelts ||
+            strcmp(ou->host, APR_ARRAY_IDX(aliases, ou->vhost - 1, char *))) {
+            return 0;
+        }
+        count++;
+    }
+    if (count != aliases->nelts) {
+        return 0;
+    }
+
+    count = 0;
+    size = loc_get_max_size_context();
+    id = apr_palloc(r->pool, sizeof(int) * size);
+    size = get_node_context_ids(node, id);
+    for (i = 0; i < size; i++) {
+        contextinfo_t *ou;
+        if (get_context(contextstatsmem, &ou, id[i]) != APR_SUCCESS || ou->node != node) {
+            continue;
+        }
+        if (ou->status != STOPPED || ou->vhost < 1 || ou->vhost > aliases->nelts) {
+            return 0;
+        }
+        for (j = 0; j < contexts->nelts; j++) {
+            if (strcmp(ou->context, APR_ARRAY_IDX(contexts, j, char *)) == 0) {
+                break;
+            }
+        }
+        if (j == contexts->nelts) {
+            return 0;
+        }
+        count++;
+    }
+    return count == aliases->nelts * contexts->nelts;
+}
+
 /**
  * Check if another node has the same worker
  */
@@ -949,6 +1296,7 @@ static void process_config_balancer_defaults(request_rec *r, balancerinfo_t *bal
     strcpy(balancerinfo->StickySessionPath, "jsessionid");
     balancerinfo->Maxattempts = 1;
     balancerinfo->Timeout = 0;
+    balancerinfo->SlowStart = mconf->slow_start;
 }
 
 static void process_config_node_defaults(request_rec *r, nodeinfo_t *nodeinfo, mod_manager_config *mconf)
@@ -1024,6 +1372,13 @@ static char *process_config_balancer(const request_rec *r, const char *key, char
     if (strcasecmp(key, "Maxattempts") == 0) {
         balancerinfo->Maxattempts = atoi(val);
     }
+    if (strcasecmp(key, "SlowStart") == 0) {
+        balancerinfo->SlowStart = atoi(val);
+        if (balancerinfo->SlowStart < 0) {
+            *errtype = TYPESYNTAX;
+            return SSLOBAD;
+        }
+    }
 
     return NULL;
 }
@@ -1047,6 +1402,28 @@ static char *process_config_node(const char *key, char *val, nodeinfo_t *nodeinf
         }
         strcpy(nodeinfo->mess.Domain, val);
     }
+    /* Locality of the node for the failover */
+    if (strcasecmp(key, "Region") == 0) {
+        if (strlen(val) >= sizeof(nodeinfo->mess.Region)) {
+            *errtype = TYPESYNTAX;
+            return SLOCBIG;
+        }
+        strcpy(nodeinfo->mess.Region, val);
+    }
+    if (strcasecmp(key, "Zone") == 0) {
+        if (strlen(val) >= sizeof(nodeinfo->mess.Zone)) {
+            *errtype = TYPESYNTAX;
+            return SLOCBIG;
+        }
+        strcpy(nodeinfo->mess.Zone, val);
+    }
+    if (strcasecmp(key, "Rack") == 0) {
+        if (strlen(val) >= sizeof(nodeinfo->mess.Rack)) {
+            *errtype = TYPESYNTAX;
+            return SLOCBIG;
+        }
+        strcpy(nodeinfo->mess.Rack, val);
+    }
     if (strcasecmp(key, "Host") == 0) {
         char *p_read = val, *p_write = val;
         int flag = 0;
@@ -1263,6 +1640,7 @@ static char *process_context_alias(char *key, char *val, apr_array_header_t *con
  * StickySessionForce	Timeout	Maxattempts
  * JvmRoute?: <JvmRoute>
  * Domain: <Domain>
+ * Region, Zone, Rack: <locality of the node>
  * <Host: <Node IP>
  * Port: <Connector Port>
  * Type: <Type of the connector>
@@ -1365,6 +1743,10 @@ static char *process_config(request_rec *r, char **ptr, int *errtype)
         nodeinfo.mess.ResponseFieldSize = mconf->response_field_size;
     }
 
+    /* The node (re)starts, ramp up its load factor */
+    nodeinfo.mess.slowstart = apr_time_from_sec(balancerinfo.SlowStart);
+    nodeinfo.mess.rampstart = apr_time_now();
+
     /* check for removed node */
     node = read_node(nodestatsmem, &nodeinfo);
     if (node != NULL) {
@@ -1471,6 +1853,23 @@ static char *process_config(request_rec *r, char **ptr, int *errtype)
         oldbalancerinfo = *balancerinfo_ptr;
     }
 
+    /*
+     * The node resends the same CONFIG (network problems, periodic registration): the tables don't change, so
+     * the version stays and the children don't resync. The mod_balancer worker is still created or updated.
+     */
+    if (clean && node != NULL && node->mess.id == id && balancerinfo_ptr != NULL &&
+        is_same_node_config(&node->mess, &nodeinfo.mess) && is_same_balancer_config(balancerinfo_ptr, &balancerinfo) &&
+        is_same_hosts_contexts(r, id, aliases, contexts)) {
+        node->updatetime = apr_time_now();
+        if (balancer_manage) {
+            apr_status_t rv = mod_manager_manage_worker(r, &nodeinfo, &balancerinfo);
+            ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, r->server, "process_config: balancer-manager returned %d", rv);
+        }
+        loc_unlock_nodes();
+        ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, r->server, "process_config: (%s) unchanged", nodeinfo.mess.JVMRoute);
+        return NULL;
+    }
+
     if (insert_update_balancer(balancerstatsmem, &balancerinfo) != APR_SUCCESS) {
         loc_unlock_nodes();
         *errtype = TYPEMEM;
@@ -1484,6 +1883,7 @@ static char *process_config(request_rec *r, char **ptr, int *errtype)
         if (removed != -1) {
             nodeinfo_t *workernode = read_node_by_id(nodestatsmem, removed);
             mark_node_removed(workernode);
+            inc_generation();
         }
         /* Revert back balancer changes */
         if (balancerinfo_ptr != NULL) {
@@ -1535,6 +1935,7 @@ static char *process_config(request_rec *r, char **ptr, int *errtype)
         } else {
             ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, r->server, "process_config: NO balancer-manager");
         }
+        inc_generation();
         loc_unlock_nodes();
         return NULL; /* Alias and Context missing */
     }
@@ -1583,6 +1984,7 @@ static char *process_config(request_rec *r, char **ptr, int *errtype)
     } else {
         ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, r->server, "process_config: NO balancer-manager");
     }
+    inc_generation();
     loc_unlock_nodes();
 
     ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, r->server, "process_config: Done");
@@ -2016,7 +2418,7 @@ static char *process_node_cmd(request_rec *r, int status, int *errtype, nodeinfo
         return NULL;
     }
     id = apr_palloc(r->pool, sizeof(int) * size);
-    size = get_ids_used_host(hoststatsmem, id);
+    size = get_node_host_ids(node->mess.id, id);
     for (i = 0; i < size; i++) {
         hostinfo_t *ou;
         int sizecontext;
@@ -2031,7 +2433,7 @@ static char *process_node_cmd(request_rec *r, int status, int *errtype, nodeinfo
         /* If the host corresponds to a node process all contextes */
         sizecontext = get_max_size_context(contextstatsmem);
         idcontext = apr_palloc(r->pool, sizeof(int) * sizecontext);
-        sizecontext = get_ids_used_context(contextstatsmem, idcontext);
+        sizecontext = get_node_context_ids(node->mess.id, idcontext);
         for (j = 0; j < sizecontext; j++) {
             contextinfo_t *context;
             if (get_context(contextstatsmem, &context, idcontext[j]) != APR_SUCCESS) {
@@ -2043,12 +2445,12 @@ static char *process_node_cmd(request_rec *r, int status, int *errtype, nodeinfo
                     context->status = status;
                     insert_update_context(contextstatsmem, context);
                 } else {
-                    remove_context(contextstatsmem, context->id);
+                    remove_node_context(context);
                 }
             }
         }
         if (status == REMOVE) {
-            remove_host(hoststatsmem, ou->id);
+            remove_node_host(ou);
         }
     }
 
@@ -2106,81 +2508,59 @@ static void print_app_cmd_response(request_rec *r, int cmd, const char *jvmroute
 }
 
 
-/**
- * Process an enable/disable/stop/remove application message
+/*
+ * Check that an application command has both Alias and Context
  */
-static char *process_app_cmd(request_rec *r, char **ptr, int cmd, int *errtype)
+static char *check_app_cmd(const apr_array_header_t *contexts, const apr_array_header_t *aliases, int *errtype)
 {
-    nodeinfo_t nodeinfo, *node = NULL;
+    if (apr_is_empty_array(contexts) && apr_is_empty_array(aliases)) {
+        *errtype = TYPESYNTAX;
+        return NOCONAL;
+    } else if (apr_is_empty_array(contexts) && !apr_is_empty_array(aliases)) {
+        *errtype = TYPESYNTAX;
+        return SALIBAD;
+    } else if (!apr_is_empty_array(contexts) && apr_is_empty_array(aliases)) {
+        *errtype = TYPESYNTAX;
+        return SCONBAD;
+    }
+    return NULL;
+}
 
-    apr_array_header_t *aliases = apr_array_make(r->pool, 4, sizeof(char *));
-    apr_array_header_t *contexts = apr_array_make(r->pool, 4, sizeof(char *));
-    apr_array_header_t *updated_aliases_contexts = NULL;
+/*
+ * Check if an ENABLE-APP makes the node get requests again: it had no ENABLED context or its worker is
+ * in error or standby. The slow-start ramp only restarts in that case. The nodes must be locked
+ */
+static int node_starts_serving(request_rec *r, const nodeinfo_t *node)
+{
+    const proxy_worker_shared *proxystat = (const proxy_worker_shared *)((const char *)node + NODEOFFSET);
+    int size, i;
+    int *id;
 
-    int i = 0, j = 0, vid = 0;
-    hostinfo_t hostinfo, *host = NULL;
-    int global = strcmp(r->filename, NODE_COMMAND) == 0;
-    char *err_msg;
-
-    memset(&nodeinfo.mess, '\0', sizeof(nodeinfo.mess));
-
-    while (ptr[i]) {
-        if (strcasecmp(ptr[i], "JVMRoute") == 0) {
-            if (strlen(ptr[i + 1]) >= sizeof(nodeinfo.mess.JVMRoute)) {
-                *errtype = TYPESYNTAX;
-                return SROUBIG;
-            }
-            strcpy(nodeinfo.mess.JVMRoute, ptr[i + 1]);
-            nodeinfo.mess.id = -1;
-        }
-        err_msg = process_context_alias(ptr[i], ptr[i + 1], contexts, aliases, errtype);
-        if (err_msg) {
-            return err_msg;
-        }
-
-        i += 2;
-    }
-
-    /* Check for JVMRoute, Alias and Context */
-    if (nodeinfo.mess.JVMRoute[0] == '\0') {
-        *errtype = TYPESYNTAX;
-        return SROUBAD;
+    if (proxystat->lbfactor <= 0 || (proxystat->status & (PROXY_WORKER_NOT_USABLE_BITMAP | PROXY_WORKER_HOT_STANDBY))) {
+        return 1;
     }
-
-    /* Note: Non-wildcarded requests require Alias and Context */
-    if (!global) {
-        if (apr_is_empty_array(contexts) && apr_is_empty_array(aliases)) {
-            *errtype = TYPESYNTAX;
-            return NOCONAL;
-        } else if (apr_is_empty_array(contexts) && !apr_is_empty_array(aliases)) {
-            *errtype = TYPESYNTAX;
-            return SALIBAD;
-        } else if (!apr_is_empty_array(contexts) && apr_is_empty_array(aliases)) {
-            *errtype = TYPESYNTAX;
-            return SCONBAD;
+    size = loc_get_max_size_context();
+    id = apr_palloc(r->pool, sizeof(int) * size);
+    size = get_node_context_ids(node->mess.id, id);
+    for (i = 0; i < size; i++) {
+        contextinfo_t *ou;
+        if (get_context(contextstatsmem, &ou, id[i]) == APR_SUCCESS && ou->node == node->mess.id &&
+            ou->status == ENABLED) {
+            return 0;
         }
     }
+    return 1;
+}
 
-    /* Read the node */
-    loc_lock_nodes();
-    node = read_node(nodestatsmem, &nodeinfo);
-    if (node == NULL || node->mess.remove) {
-        loc_unlock_nodes();
-        /* TODO: Let's consider returning NULL for an already removed node */
-        /* Even for a removed node act has if the node wasn't found */
-        *errtype = TYPEMEM;
-        return apr_psprintf(r->pool, MNODERD, nodeinfo.mess.JVMRoute);
-    }
-
-    inc_version_node();
-
-    /* Process the * APP commands */
-    if (global) {
-        char *ret;
-        ret = process_node_cmd(r, cmd, errtype, node);
-        loc_unlock_nodes();
-        return ret;
-    }
+/*
+ * Apply an application command to the aliases and contexts of a node, the nodes must be locked
+ */
+static void apply_app_cmd(request_rec *r, nodeinfo_t *node, int cmd, const apr_array_header_t *aliases,
+                          const apr_array_header_t *contexts)
+{
+    apr_array_header_t *updated_aliases_contexts = NULL;
+    int i = 0, j = 0, vid = 0;
+    hostinfo_t hostinfo, *host = NULL;
 
     /* We'll track which contexts for which aliases were processed successfully */
     updated_aliases_contexts = apr_array_make(r->pool, aliases->nelts * contexts->nelts, sizeof(int));
@@ -2210,7 +2590,7 @@ static char *process_app_cmd(request_rec *r, char **ptr, int cmd, int *errtype)
             /* Otherwise we have to create a new host */
             size = loc_get_max_size_host();
             id = apr_palloc(r->pool, sizeof(int) * size);
-            size = get_ids_used_host(hoststatsmem, id);
+            size = get_node_host_ids(node->mess.id, id);
             for (i = 0; i < size; i++) {
                 hostinfo_t *ou;
                 if (get_host(hoststatsmem, &ou, id[i]) != APR_SUCCESS) {
@@ -2223,7 +2603,7 @@ static char *process_app_cmd(request_rec *r, char **ptr, int cmd, int *errtype)
             hostinfo.vhost = ++vid; /* Use next one. */
             ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, r->server,
                          "process_app_cmd: adding vhost: %d node: %d route: %s, alias: %s", vid, node->mess.id,
-                         nodeinfo.mess.JVMRoute, current_alias);
+                         node->mess.JVMRoute, current_alias);
             /* If the Host doesn't exist yet create it */
             if (insert_update_host(hoststatsmem, &hostinfo) != APR_SUCCESS) {
                 /* creation failed, but we'll continue with the rest of aliases/hosts */
@@ -2231,6 +2611,7 @@ static char *process_app_cmd(request_rec *r, char **ptr, int cmd, int *errtype)
                              current_alias);
                 continue;
             }
+            index_host(node->mess.id, hostinfo.id, 1);
 
             host = read_host(hoststatsmem, &hostinfo);
             if (host == NULL) {
@@ -2301,7 +2682,7 @@ static char *process_app_cmd(request_rec *r, char **ptr, int cmd, int *errtype)
         if (cmd == REMOVE) {
             int size = loc_get_max_size_context();
             int *id = apr_palloc(r->pool, sizeof(int) * size);
-            size = get_ids_used_context(contextstatsmem, id);
+            size = get_node_context_ids(node->mess.id, id);
             for (i = 0; i < size; i++) {
                 contextinfo_t *ou;
                 if (get_context(contextstatsmem, &ou, id[i]) != APR_SUCCESS) {
@@ -2314,7 +2695,7 @@ static char *process_app_cmd(request_rec *r, char **ptr, int cmd, int *errtype)
             if (i == size) {
                 int size = loc_get_max_size_host();
                 int *id = apr_palloc(r->pool, sizeof(int) * size);
-                size = get_ids_used_host(hoststatsmem, id);
+                size = get_node_host_ids(node->mess.id, id);
                 for (i = 0; i < size; i++) {
                     hostinfo_t *ou;
 
@@ -2322,15 +2703,91 @@ static char *process_app_cmd(request_rec *r, char **ptr, int cmd, int *errtype)
                         continue;
                     }
                     if (ou->vhost == host->vhost && ou->node == node->mess.id) {
-                        remove_host(hoststatsmem, ou->id);
+                        remove_node_host(ou);
                     }
                 }
             }
         }
     }
 
+    print_app_cmd_response(r, cmd, node->mess.JVMRoute, updated_aliases_contexts, aliases, contexts);
+}
+
+/**
+ * Process an enable/disable/stop/remove application message
+ */
+static char *process_app_cmd(request_rec *r, char **ptr, int cmd, int *errtype)
+{
+    nodeinfo_t nodeinfo, *node = NULL;
+
+    apr_array_header_t *aliases = apr_array_make(r->pool, 4, sizeof(char *));
+    apr_array_header_t *contexts = apr_array_make(r->pool, 4, sizeof(char *));
+
+    int i = 0;
+    int global = strcmp(r->filename, NODE_COMMAND) == 0;
+    char *err_msg;
+
+    memset(&nodeinfo.mess, '\0', sizeof(nodeinfo.mess));
+
+    while (ptr[i]) {
+        if (strcasecmp(ptr[i], "JVMRoute") == 0) {
+            if (strlen(ptr[i + 1]) >= sizeof(nodeinfo.mess.JVMRoute)) {
+                *errtype = TYPESYNTAX;
+                return SROUBIG;
+            }
+            strcpy(nodeinfo.mess.JVMRoute, ptr[i + 1]);
+            nodeinfo.mess.id = -1;
+        }
+        err_msg = process_context_alias(ptr[i], ptr[i + 1], contexts, aliases, errtype);
+        if (err_msg) {
+            return err_msg;
+        }
+
+        i += 2;
+    }
+
+    /* Check for JVMRoute, Alias and Context */
+    if (nodeinfo.mess.JVMRoute[0] == '\0') {
+        *errtype = TYPESYNTAX;
+        return SROUBAD;
+    }
+
+    /* Note: Non-wildcarded requests require Alias and Context */
+    if (!global) {
+        err_msg = check_app_cmd(contexts, aliases, errtype);
+        if (err_msg) {
+            return err_msg;
+        }
+    }
+
+    /* Read the node */
+    loc_lock_nodes();
+    node = read_node(nodestatsmem, &nodeinfo);
+    if (node == NULL || node->mess.remove) {
+        loc_unlock_nodes();
+        /* TODO: Let's consider returning NULL for an already removed node */
+        /* Even for a removed node act has if the node wasn't found */
+        *errtype = TYPEMEM;
+        return apr_psprintf(r->pool, MNODERD, nodeinfo.mess.JVMRoute);
+    }
+
+    inc_version_node();
+
+    /* The node gets requests again, ramp up its load factor */
+    if (cmd == ENABLED && node_starts_serving(r, node)) {
+        node->mess.rampstart = apr_time_now();
+    }
+
+    /* Process the * APP commands */
+    if (global) {
+        char *ret;
+        ret = process_node_cmd(r, cmd, errtype, node);
+        loc_unlock_nodes();
+        return ret;
+    }
+
     /* This is always !global (see the global return above). */
-    print_app_cmd_response(r, cmd, nodeinfo.mess.JVMRoute, updated_aliases_contexts, aliases, contexts);
+    apply_app_cmd(r, node, cmd, aliases, contexts);
 
     loc_unlock_nodes();
     return NULL;
@@ -2356,6 +2813,123 @@ static char *process_remove(request_rec *r, char **ptr, int *errtype)
     return process_app_cmd(r, ptr, REMOVE, errtype);
 }
 
+/* One command of a BATCH-APP message */
+typedef struct app_cmd
+{
+    int cmd;
+    apr_array_header_t *aliases;
+    apr_array_header_t *contexts;
+} app_cmd_t;
+
+static int app_cmd_status(const char *val)
+{
+    if (strcasecmp(val, "ENABLE-APP") == 0) {
+        return ENABLED;
+    } else if (strcasecmp(val, "DISABLE-APP") == 0) {
+        return DISABLED;
+    } else if (strcasecmp(val, "STOP-APP") == 0) {
+        return STOPPED;
+    } else if (strcasecmp(val, "REMOVE-APP") == 0) {
+        return REMOVE;
+    }
+    return -1;
+}
+
+/*
+ * Process a BATCH-APP message:
+ * JVMRoute: <JvmRoute>
+ * Command: <ENABLE-APP|DISABLE-APP|STOP-APP|REMOVE-APP>
+ * Alias: <vhost list>
+ * Context: <context list>
+ * Command, Alias and Context can be repeated, the Alias and Context belong to the Command before them.
+ * All the commands are applied with one lock of the nodes and one version change.
+ */
+static char *process_batch_app(request_rec *r, char **ptr, int *errtype)
+{
+    nodeinfo_t nodeinfo, *node;
+    apr_array_header_t *cmds = apr_array_make(r->pool, 4, sizeof(app_cmd_t));
+    app_cmd_t *current = NULL;
+    char *err_msg;
+    int i = 0;
+
+    memset(&nodeinfo.mess, '\0', sizeof(nodeinfo.mess));
+
+    while (ptr[i]) {
+        if (strcasecmp(ptr[i], "JVMRoute") == 0) {
+            if (strlen(ptr[i + 1]) >= sizeof(nodeinfo.mess.JVMRoute)) {
+                *errtype = TYPESYNTAX;
+                return SROUBIG;
+            }
+            strcpy(nodeinfo.mess.JVMRoute, ptr[i + 1]);
+            nodeinfo.mess.id = -1;
+        } else if (strcasecmp(ptr[i], "Command") == 0) {
+            current = apr_array_push(cmds);
+            current->cmd = app_cmd_status(ptr[i + 1]);
+            if (current->cmd == -1) {
+                *errtype = TYPESYNTAX;
+                return apr_psprintf(r->pool, SBATCMD, ptr[i + 1]);
+            }
+            current->aliases = apr_array_make(r->pool, 4, sizeof(char *));
+            current->contexts = apr_array_make(r->pool, 4, sizeof(char *));
+        } else if (strcasecmp(ptr[i], "Alias") == 0 || strcasecmp(ptr[i], "Context") == 0) {
+            if (current == NULL) {
+                *errtype = TYPESYNTAX;
+                return SBATNOC;
+            }
+            err_msg = process_context_alias(ptr[i], ptr[i + 1], current->contexts, current->aliases, errtype);
+            if (err_msg) {
+                return err_msg;
+            }
+        }
+
+        i += 2;
+    }
+
+    if (nodeinfo.mess.JVMRoute[0] == '\0') {
+        *errtype = TYPESYNTAX;
+        return SROUBAD;
+    }
+    if (apr_is_empty_array(cmds)) {
+        *errtype = TYPESYNTAX;
+        return SBATNOC;
+    }
+    for (i = 0; i < cmds->nelts; i++) {
+        current = &APR_ARRAY_IDX(cmds, i, app_cmd_t);
+        err_msg = check_app_cmd(current->contexts, current->aliases, errtype);
+        if (err_msg) {
+            return err_msg;
+        }
+    }
+
+    loc_lock_nodes();
+    node = read_node(nodestatsmem, &nodeinfo);
+    if (node == NULL || node->mess.remove) {
+        loc_unlock_nodes();
+        *errtype = TYPEMEM;
+        return apr_psprintf(r->pool, MNODERD, nodeinfo.mess.JVMRoute);
+    }
+
+    inc_version_node();
+
+    /* The node gets requests again, ramp up its load factor (checked before the commands change the contexts) */
+    for (i = 0; i < cmds->nelts; i++) {
+        if (APR_ARRAY_IDX(cmds, i, app_cmd_t).cmd == ENABLED) {
+            if (node_starts_serving(r, node)) {
+                node->mess.rampstart = apr_time_now();
+            }
+            break;
+        }
+    }
+
+    for (i = 0; i < cmds->nelts; i++) {
+        current = &APR_ARRAY_IDX(cmds, i, app_cmd_t);
+        apply_app_cmd(r, node, current->cmd, current->aliases, current->contexts);
+    }
+
+    loc_unlock_nodes();
+    return NULL;
+}
+
 /*
  * Call the ping/pong logic
  * Do a ping/png request to the node and set the load factor.
@@ -2383,19 +2957,46 @@ static void print_status_response(request_rec *r, const char *jvmroute, int node
     ap_rprintf(r, "\n");
 }
 
+/*
+ * Combine the Load of STATUS with the reported metrics: the load is scaled by the weighted average of
+ * the headroom (100 - usage) of the metrics. It stays at least 1, the node must not become a standby one.
+ */
+static int combine_load_metrics(const mod_manager_config *mconf, int load, const int *metrics, unsigned mask)
+{
+    apr_int64_t headroom = 0, weights = 0;
+    int i;
+
+    for (i = 0; i < LOAD_METRICS; i++) {
+        int weight = mconf->metric_weights[i] < 0 ? 1 : mconf->metric_weights[i];
+        if (mask & (1u << i)) {
+            headroom += (apr_int64_t)weight * (100 - metrics[i]);
+            weights += weight;
+        }
+    }
+    if (load <= 0 || weights == 0) {
+        return load;
+    }
+    load = (int)(load * headroom / (100 * weights));
+    return load < 1 ? 1 : load;
+}
+
 /*
  * Process the STATUS command
  * Load -1 : Broken
  * Load 0  : Standby.
  * Load 1-100 : Load factor.
+ * Cpu, Heap, Queue, Threads 0-100 : optional usage in percent, they reduce the load factor.
  */
 static char *process_status(request_rec *r, const char *const *ptr, int *errtype)
 {
     int load = -2;
     nodeinfo_t nodeinfo;
     nodeinfo_t *node;
+    int metrics[LOAD_METRICS] = {0};
+    unsigned mask = 0;
+    mod_manager_config *mconf = ap_get_module_config(r->server->module_config, &manager_module);
 
-    int i = 0;
+    int i = 0, j;
 
     ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, r->server, "Processing STATUS");
     while (ptr[i]) {
@@ -2413,8 +3014,22 @@ static char *process_status(request_rec *r, const char *const *ptr, int *errtype
                 return "TODO: Bad value for Load";
             }
         } else {
-            *errtype = TYPESYNTAX;
-            return apr_psprintf(r->pool, SBADFLD, ptr[i]);
+            for (j = 0; j < LOAD_METRICS; j++) {
+                if (strcasecmp(ptr[i], load_metrics[j]) == 0) {
+                    break;
+                }
+            }
+            if (j == LOAD_METRICS) {
+                *errtype = TYPESYNTAX;
+                return apr_psprintf(r->pool, SBADFLD, ptr[i]);
+            }
+            metrics[j] = -1;
+            sscanf(ptr[i + 1], "%d", &metrics[j]);
+            if (metrics[j] < 0 || metrics[j] > 100) {
+                *errtype = TYPESYNTAX;
+                return apr_psprintf(r->pool, SMETBAD, load_metrics[j]);
+            }
+            mask |= 1u << j;
         }
         i += 2;
     }
@@ -2427,11 +3042,16 @@ static char *process_status(request_rec *r, const char *const *ptr, int *errtype
     /* Read the node */
     loc_lock_nodes();
     node = read_node(nodestatsmem, &nodeinfo);
+    if (node != NULL) {
+        memcpy(node->mess.metrics, metrics, sizeof(metrics));
+        node->mess.metricsmask = mask;
+    }
     loc_unlock_nodes();
     if (node == NULL) {
         *errtype = TYPEMEM;
         return apr_psprintf(r->pool, MNODERD, nodeinfo.mess.JVMRoute);
     }
+    load = combine_load_metrics(mconf, load, metrics, mask);
 
     /*
      * If the node is usualable do a ping/pong to prevent Split-Brain Syndrome
@@ -2608,43 +3228,158 @@ static int mod_manager_hex2c(const char *x)
 }
 
 /*
- * Processing of decoded characters
+ * Incremental parser of the MCMP messages: the bytes are split on the raw '&' and '=' and decoded
+ * while they are read from the brigade buckets, the tokens are written once in buff.
  */
-static apr_status_t decodeenc(char **ptr)
-{
-    int val, i, j;
-    char ch;
-    val = 0;
-    while (NULL != ptr[val]) {
-        if (ptr[val][0] == '\0') {
-            /* special case for no characters */
-            val++;
-            continue;
-        }
-        for (i = 0, j = 0; ptr[val][i] != '\0'; i++, j++) {
-            /* decode it if not already done */
-            ch = ptr[val][i];
-            if (ch == '%' && apr_isxdigit(ptr[val][i + 1]) && apr_isxdigit(ptr[val][i + 2])) {
-                ch = (char)mod_manager_hex2c(&(ptr[val][i + 1]));
-                i += 2;
-            }
+typedef struct mcmp_parser
+{
+    char *buff;              /* decoded tokens, '\0' terminated */
+    apr_size_t len;          /* bytes used in buff */
+    apr_array_header_t *ptr; /* start of each token in buff */
+    char escape[3];          /* pending "%xx" sequence */
+    int escapelen;
+    int done;  /* a '\0' ends the message */
+    int error; /* forbidden character found */
+} mcmp_parser_t;
 
-            /* process decoded, = and & are legit characters */
-            /* from apr_escape_entity() */
-            if (ch == '<' || ch == '>' || ch == '\"' || ch == '\'') {
-                return TYPESYNTAX;
-            }
-            /* from apr_escape_shell() */
-            if (ch == '\r' || ch == '\n') {
-                return TYPESYNTAX;
+static void mcmp_parser_init(mcmp_parser_t *parser, apr_pool_t *p, apr_size_t size)
+{
+    parser->buff = apr_palloc(p, size + 1);
+    parser->len = 0;
+    parser->ptr = apr_array_make(p, 16, sizeof(char *));
+    *(char **)apr_array_push(parser->ptr) = parser->buff;
+    parser->escapelen = 0;
+    parser->done = 0;
+    parser->error = 0;
+}
+
+/*
+ * Processing of decoded characters, = and & are legit characters
+ */
+static void mcmp_parser_putc(mcmp_parser_t *parser, char ch)
+{
+    /* from apr_escape_entity() and apr_escape_shell() */
+    if (ch == '<' || ch == '>' || ch == '\"' || ch == '\'' || ch == '\r' || ch == '\n') {
+        parser->error = 1;
+    }
+    parser->buff[parser->len++] = ch;
+}
+
+/* a '%' not followed by two hex digits is kept as it is */
+static void mcmp_parser_flush(mcmp_parser_t *parser)
+{
+    int i;
+    for (i = 0; i < parser->escapelen; i++) {
+        mcmp_parser_putc(parser, parser->escape[i]);
+    }
+    parser->escapelen = 0;
+}
+
+static void mcmp_parser_feed(mcmp_parser_t *parser, const char *data, apr_size_t len)
+{
+    apr_size_t i;
+
+    for (i = 0; i < len && !parser->done; i++) {
+        char ch = data[i];
+        if (parser->escapelen) {
+            if (apr_isxdigit(ch)) {
+                parser->escape[parser->escapelen++] = ch;
+                if (parser->escapelen == 3) {
+                    parser->escapelen = 0;
+                    mcmp_parser_putc(parser, (char)mod_manager_hex2c(&parser->escape[1]));
+                }
+                continue;
             }
+            mcmp_parser_flush(parser);
+        }
+        switch (ch) {
+        case '\0':
+            parser->done = 1;
+            break;
+        case '%':
+            parser->escape[parser->escapelen++] = ch;
+            break;
+        case '&':
+        case '=':
+            /* our separators */
+            parser->buff[parser->len++] = '\0';
+            *(char **)apr_array_push(parser->ptr) = parser->buff + parser->len;
+            break;
+        default:
+            mcmp_parser_putc(parser, ch);
+        }
+    }
+}
 
-            ptr[val][j] = ch;
+/*
+ * Terminate the last token and return the NULL terminated key/value array or NULL if the message is invalid
+ */
+static char **mcmp_parser_end(mcmp_parser_t *parser)
+{
+    mcmp_parser_flush(parser);
+    parser->buff[parser->len] = '\0';
+    *(char **)apr_array_push(parser->ptr) = NULL;
+    if (parser->error) {
+        return NULL;
+    }
+    return (char **)parser->ptr->elts;
+}
+
+/*
+ * Digest of the states displayed by INFO that change without changing the generation of the tables.
+ * The traffic counters (elected, read, transferred, busy) are left out, they change with every request.
+ */
+static apr_uint64_t info_digest(request_rec *r)
+{
+    apr_uint64_t digest = 0;
+    int size, i;
+    int *id;
+
+    size = loc_get_max_size_node();
+    id = apr_palloc(r->pool, sizeof(int) * size);
+    size = get_ids_used_node(nodestatsmem, id);
+    for (i = 0; i < size; i++) {
+        nodeinfo_t *ou;
+        const proxy_worker_shared *proxystat;
+        if (get_node(nodestatsmem, &ou, id[i]) != APR_SUCCESS) {
+            continue;
+        }
+        proxystat = read_shared_by_node(r, ou);
+        if (proxystat) {
+            digest = digest * 31 + proxystat->status;
+            digest = digest * 31 + proxystat->lbfactor;
         }
-        ptr[val][j] = '\0';
-        val++;
     }
-    return APR_SUCCESS;
+
+    size = loc_get_max_size_context();
+    id = apr_palloc(r->pool, sizeof(int) * size);
+    size = get_ids_used_context(contextstatsmem, id);
+    for (i = 0; i < size; i++) {
+        contextinfo_t *ou;
+        if (get_context(contextstatsmem, &ou, id[i]) == APR_SUCCESS) {
+            digest = digest * 31 + ou->status;
+        }
+    }
+    return digest;
+}
+
+/*
+ * Set the ETag of the INFO or DUMP response and check it against If-None-Match.
+ * The ETag is the generation of the tables, for INFO with the digest of the states. The ETag of INFO
+ * is weak: a 304 may hide traffic counters that changed since the cached response.
+ */
+static int is_not_modified(request_rec *r, int info)
+{
+    const char *accept_header = apr_table_get(r->headers_in, "Accept");
+    const char *match = apr_table_get(r->headers_in, "If-None-Match");
+    int xml = accept_header && strstr(accept_header, XML_CONTENT_TYPE) != NULL;
+    apr_uint32_t generation = get_generation();
+    apr_uint64_t digest = info ? info_digest(r) : 0;
+    const char *etag = apr_psprintf(r->pool, "\"%s%s%u-%" APR_UINT64_T_HEX_FMT "\"", info ? "i" : "d",
+                                    xml ? "x" : "t", generation, digest);
+
+    apr_table_setn(r->err_headers_out, "ETag", info ? apr_pstrcat(r->pool, "W/", etag, NULL) : etag);
+    return match != NULL && (strcmp(match, "*") == 0 || strstr(match, etag) != NULL);
 }
 
 /*
@@ -2663,6 +3398,8 @@ static int is_our_method(const request_rec *r)
         ours = 1;
     } else if (strcasecmp(r->method, "REMOVE-APP") == 0) {
         ours = 1;
+    } else if (strcasecmp(r->method, "BATCH-APP") == 0) {
+        ours = 1;
     } else if (strcasecmp(r->method, "STATUS") == 0) {
         ours = 1;
     } else if (strcasecmp(r->method, "DUMP") == 0) {
@@ -2839,7 +3576,7 @@ static void print_contexts(request_rec *r, int reduce_display, int allow_cmd, in
         return;
     }
     id = apr_palloc(r->pool, sizeof(int) * size);
-    size = get_ids_used_context(contextstatsmem, id);
+    size = get_node_context_ids(node, id);
     for (i = 0; i < size; i++) {
         contextinfo_t *ou;
         if (get_context(contextstatsmem, &ou, id[i]) != APR_SUCCESS) {
@@ -2850,6 +3587,10 @@ static void print_contexts(request_rec *r, int reduce_display, int allow_cmd, in
         }
         ap_rprintf(r, "%.*s, Status: %s Request: %d ", CONTEXTSZ, mc_escape_html(r->pool, ou->context, CONTEXTSZ),
                    context_status_to_string(ou->status), ou->nbrequests);
+        if (ou->nbqueued || ou->nbwaited) {
+            ap_rprintf(r, "Queued: %d Waited: %d (%" APR_TIME_T_FMT " ms avg) ", ou->nbqueued, ou->nbwaited,
+                       ou->nbwaited ? apr_time_as_msec(ou->waittime) / ou->nbwaited : 0);
+        }
         if (allow_cmd) {
             print_context_command(r, ou, Alias, JVMRoute);
         }
@@ -2870,7 +3611,7 @@ static void print_hosts(request_rec *r, int reduce_display, int allow_cmd, int n
         return;
     }
     id = apr_palloc(r->pool, sizeof(int) * size);
-    size = get_ids_used_host(hoststatsmem, id);
+    size = get_node_host_ids(node, id);
     idChecker = apr_pcalloc(r->pool, sizeof(int) * size);
     for (i = 0; i < size; i++) {
         hostinfo_t *ou;
@@ -2993,29 +3734,216 @@ static void print_domain(request_rec *r, int reduce_display)
 #endif
 }
 
-static int count_sessionid(request_rec *r, const char *route)
+/*
+ * Count the sessionids of every route in one pass over the table
+ */
+static apr_hash_t *count_sessionids(request_rec *r)
 {
     int size, i;
     int *id;
-    int count = 0;
+    apr_hash_t *counts = apr_hash_make(r->pool);
 
-    /* Count the sessionid corresponding to the route */
     size = loc_get_max_size_sessionid();
     if (size == 0) {
-        return 0;
+        return counts;
     }
     id = apr_palloc(r->pool, sizeof(int) * size);
     size = get_ids_used_sessionid(sessionidstatsmem, id);
     for (i = 0; i < size; i++) {
         sessionidinfo_t *ou;
+        int *count;
         if (get_sessionid(sessionidstatsmem, &ou, id[i]) != APR_SUCCESS) {
             continue;
         }
-        if (strcmp(route, ou->JVMRoute) == 0) {
-            count++;
+        count = apr_hash_get(counts, ou->JVMRoute, APR_HASH_KEY_STRING);
+        if (count == NULL) {
+            count = apr_pcalloc(r->pool, sizeof(int));
+            apr_hash_set(counts, apr_pstrndup(r->pool, ou->JVMRoute, JVMROUTESZ), APR_HASH_KEY_STRING, count);
         }
+        (*count)++;
     }
-    return count;
+    return counts;
+}
+
+static int count_sessionid(apr_hash_t *counts, const char *route)
+{
+    int *count = apr_hash_get(counts, route, APR_HASH_KEY_STRING);
+    return count ? *count : 0;
+}
+
+/*
+ * Write a JSON string, escaping what has to be
+ */
+static void json_string(request_rec *r, apr_bucket_brigade *bb, const char *str, apr_size_t maxlen)
+{
+    apr_size_t i, start = 0;
+
+    apr_brigade_putc(bb, ap_filter_flush, r->output_filters, '"');
+    for (i = 0; i < maxlen && str[i] != '\0'; i++) {
+        unsigned char ch = (unsigned char)str[i];
+        if (ch != '"' && ch != '\\' && ch >= 0x20) {
+            continue;
+        }
+        apr_brigade_write(bb, ap_filter_flush, r->output_filters, str + start, i - start);
+        if (ch < 0x20) {
+            apr_brigade_printf(bb, ap_filter_flush, r->output_filters, "\\u%04x", ch);
+        } else {
+            apr_brigade_putc(bb, ap_filter_flush, r->output_filters, '\\');
+            apr_brigade_putc(bb, ap_filter_flush, r->output_filters, (char)ch);
+        }
+        start = i + 1;
+    }
+    apr_brigade_write(bb, ap_filter_flush, r->output_filters, str + start, i - start);
+    apr_brigade_putc(bb, ap_filter_flush, r->output_filters, '"');
+}
+
+/*
+ * Process the JSON view of the cluster: the tables and the live counters, written through a brigade
+ */
+static char *process_json(request_rec *r, int *errtype)
+{
+    int size, i, j;
+    int *id;
+    const char *sep;
+    apr_hash_t *sessions = count_sessionids(r);
+    apr_bucket_brigade *bb = apr_brigade_create(r->pool, r->connection->bucket_alloc);
+    ap_filter_t *f = r->output_filters;
+    (void)errtype;
+
+    ap_set_content_type(r, "application/json");
+    apr_brigade_printf(bb, ap_filter_flush, f, "{\"version\":\"%s\",\"generation\":%u,\"balancers\":[",
+                       MOD_CLUSTER_EXPOSED_VERSION, get_generation());
+
+    sep = "";
+    size = loc_get_max_size_balancer();
+    id = apr_palloc(r->pool, sizeof(int) * size);
+    size = get_ids_used_balancer(balancerstatsmem, id);
+    for (i = 0; i < size; i++) {
+        balancerinfo_t *ou;
+        if (get_balancer(balancerstatsmem, &ou, id[i]) != APR_SUCCESS) {
+            continue;
+        }
+        apr_brigade_printf(bb, ap_filter_flush, f, "%s{\"id\":%d,\"name\":", sep, id[i]);
+        json_string(r, bb, ou->balancer, sizeof(ou->balancer));
+        apr_brigade_printf(bb, ap_filter_flush, f, ",\"stickySession\":%d,\"stickySessionCookie\":",
+                           ou->StickySession);
+        json_string(r, bb, ou->StickySessionCookie, sizeof(ou->StickySessionCookie));
+        apr_brigade_puts(bb, ap_filter_flush, f, ",\"stickySessionPath\":");
+        json_string(r, bb, ou->StickySessionPath, sizeof(ou->StickySessionPath));
+        apr_brigade_printf(bb, ap_filter_flush, f,
+                           ",\"stickySessionRemove\":%d,\"stickySessionForce\":%d,\"timeout\":%d,"
+                           "\"maxAttempts\":%d}",
+                           ou->StickySessionRemove, ou->StickySessionForce, (int)apr_time_sec(ou->Timeout),
+                           ou->Maxattempts);
+        sep = ",";
+    }
+
+    apr_brigade_puts(bb, ap_filter_flush, f, "],\"nodes\":[");
+    sep = "";
+    size = loc_get_max_size_node();
+    id = apr_palloc(r->pool, sizeof(int) * size);
+    size = get_ids_used_node(nodestatsmem, id);
+    for (i = 0; i < size; i++) {
+        nodeinfo_t *ou;
+        const proxy_worker_shared *proxystat;
+        if (get_node(nodestatsmem, &ou, id[i]) != APR_SUCCESS) {
+            continue;
+        }
+        apr_brigade_printf(bb, ap_filter_flush, f, "%s{\"id\":%d,\"name\":", sep, id[i]);
+        json_string(r, bb, ou->mess.JVMRoute, sizeof(ou->mess.JVMRoute));
+        apr_brigade_puts(bb, ap_filter_flush, f, ",\"balancer\":");
+        json_string(r, bb, ou->mess.balancer, sizeof(ou->mess.balancer));
+        apr_brigade_puts(bb, ap_filter_flush, f, ",\"domain\":");
+        json_string(r, bb, ou->mess.Domain, sizeof(ou->mess.Domain));
+        apr_brigade_puts(bb, ap_filter_flush, f, ",\"host\":");
+        json_string(r, bb, ou->mess.Host, sizeof(ou->mess.Host));
+        apr_brigade_puts(bb, ap_filter_flush, f, ",\"port\":");
+        json_string(r, bb, ou->mess.Port, sizeof(ou->mess.Port));
+        apr_brigade_puts(bb, ap_filter_flush, f, ",\"type\":");
+        json_string(r, bb, ou->mess.Type, sizeof(ou->mess.Type));
+        apr_brigade_printf(bb, ap_filter_flush, f,
+                           ",\"flushpackets\":\"%s\",\"flushwait\":%d,\"ping\":%d,\"smax\":%d,\"ttl\":%d,"
+                           "\"timeout\":%d,\"removed\":%d,\"sessions\":%d",
+                           flush_to_str(ou->mess.flushpackets), ou->mess.flushwait / 1000,
+                           (int)apr_time_sec(ou->mess.ping), ou->mess.smax, (int)apr_time_sec(ou->mess.ttl),
+                           (int)apr_time_sec(ou->mess.timeout), ou->mess.remove,
+                           count_sessionid(sessions, ou->mess.JVMRoute));
+        proxystat = read_shared_by_node(r, ou);
+        if (proxystat) {
+            apr_brigade_printf(bb, ap_filter_flush, f,
+                               ",\"elected\":%" APR_SIZE_T_FMT ",\"read\":%" APR_OFF_T_FMT
+                               ",\"transferred\":%" APR_OFF_T_FMT ",\"busy\":%" APR_SIZE_T_FMT ",\"load\":%d",
+                               proxystat->elected, proxystat->read, proxystat->transferred, proxystat->busy,
+                               proxystat->lbfactor);
+        }
+        for (j = 0; j < LOAD_METRICS; j++) {
+            if (ou->mess.metricsmask & (1u << j)) {
+                /* the names in lower case, like the other members */
+                apr_brigade_printf(bb, ap_filter_flush, f, ",\"%c%s\":%d", apr_tolower(load_metrics[j][0]),
+                                   load_metrics[j] + 1, ou->mess.metrics[j]);
+            }
+        }
+        apr_brigade_putc(bb, ap_filter_flush, f, '}');
+        sep = ",";
+    }
+
+    apr_brigade_puts(bb, ap_filter_flush, f, "],\"hosts\":[");
+    sep = "";
+    size = loc_get_max_size_host();
+    id = apr_palloc(r->pool, sizeof(int) * size);
+    size = get_ids_used_host(hoststatsmem, id);
+    for (i = 0; i < size; i++) {
+        hostinfo_t *ou;
+        if (get_host(hoststatsmem, &ou, id[i]) != APR_SUCCESS) {
+            continue;
+        }
+        apr_brigade_printf(bb, ap_filter_flush, f, "%s{\"id\":%d,\"alias\":", sep, id[i]);
+        json_string(r, bb, ou->host, sizeof(ou->host));
+        apr_brigade_printf(bb, ap_filter_flush, f, ",\"vhost\":%d,\"node\":%d}", ou->vhost, ou->node);
+        sep = ",";
+    }
+
+    apr_brigade_puts(bb, ap_filter_flush, f, "],\"contexts\":[");
+    sep = "";
+    size = loc_get_max_size_context();
+    id = apr_palloc(r->pool, sizeof(int) * size);
+    size = get_ids_used_context(contextstatsmem, id);
+    for (i = 0; i < size; i++) {
+        contextinfo_t *ou;
+        if (get_context(contextstatsmem, &ou, id[i]) != APR_SUCCESS) {
+            continue;
+        }
+        apr_brigade_printf(bb, ap_filter_flush, f, "%s{\"id\":%d,\"path\":", sep, id[i]);
+        json_string(r, bb, ou->context, sizeof(ou->context));
+        apr_brigade_printf(bb, ap_filter_flush, f,
+                           ",\"vhost\":%d,\"node\":%d,\"status\":\"%s\",\"requests\":%d,\"queued\":%d}",
+                           ou->vhost, ou->node, context_status_to_string(ou->status), ou->nbrequests, ou->nbqueued);
+        sep = ",";
+    }
+
+    apr_brigade_puts(bb, ap_filter_flush, f, "],\"domains\":[");
+    sep = "";
+    size = loc_get_max_size_domain();
+    id = apr_palloc(r->pool, sizeof(int) * size);
+    size = get_ids_used_domain(domainstatsmem, id);
+    for (i = 0; i < size; i++) {
+        domaininfo_t *ou;
+        if (get_domain(domainstatsmem, &ou, id[i]) != APR_SUCCESS) {
+            continue;
+        }
+        apr_brigade_printf(bb, ap_filter_flush, f, "%s{\"domain\":", sep);
+        json_string(r, bb, ou->domain, sizeof(ou->domain));
+        apr_brigade_puts(bb, ap_filter_flush, f, ",\"route\":");
+        json_string(r, bb, ou->JVMRoute, sizeof(ou->JVMRoute));
+        apr_brigade_puts(bb, ap_filter_flush, f, ",\"balancer\":");
+        json_string(r, bb, ou->balancer, sizeof(ou->balancer));
+        apr_brigade_putc(bb, ap_filter_flush, f, '}');
+        sep = ",";
+    }
+    apr_brigade_puts(bb, ap_filter_flush, f, "]}\n");
+
+    ap_pass_brigade(f, bb);
+    return NULL;
 }
 
 static void process_error(request_rec *r, char *errstring, int errtype)
@@ -3060,9 +3988,12 @@ static int process_appl(const char *cmd, request_rec *r, char **ptr, int *errtyp
         *errstring = process_stop(r, ptr, errtype);
     } else if (strcasecmp(cmd, "REMOVE-APP") == 0) {
         *errstring = process_remove(r, ptr, errtype);
+    } else if (strcasecmp(cmd, "BATCH-APP") == 0) {
+        *errstring = process_batch_app(r, ptr, errtype);
     } else {
         return 0;
     }
+    inc_generation();
 
     return 1;
 }
@@ -3124,6 +4055,16 @@ static void print_proxystat(request_rec *r, int reduce_display, nodeinfo_t *node
     }
 }
 
+static void print_load_metrics(request_rec *r, const nodeinfo_t *node)
+{
+    int i;
+    for (i = 0; i < LOAD_METRICS; i++) {
+        if (node->mess.metricsmask & (1u << i)) {
+            ap_rprintf(r, ",%s: %d", load_metrics[i], node->mess.metrics[i]);
+        }
+    }
+}
+
 /*
  * Display module information
  */
@@ -3160,7 +4101,7 @@ static void modules_info(request_rec *r)
     }
 }
 
-static void print_node(request_rec *r, nodeinfo_t *ou, const mod_manager_config *mconf, int sizesessionid)
+static void print_node(request_rec *r, nodeinfo_t *ou, const mod_manager_config *mconf, apr_hash_t *sessions)
 {
     char *domain = "";
 
@@ -3204,15 +4145,20 @@ static void print_node(request_rec *r, nodeinfo_t *ou, const mod_manager_config
         ap_rprintf(r, "<br/>\n");
         ap_rprintf(r, "Balancer: %.*s,LBGroup: %.*s", (int)sizeof(ou->mess.balancer), ou->mess.balancer,
                    (int)sizeof(ou->mess.Domain), ou->mess.Domain);
+        if (ou->mess.Region[0] || ou->mess.Zone[0] || ou->mess.Rack[0]) {
+            ap_rprintf(r, ",Locality: %.*s/%.*s/%.*s", (int)sizeof(ou->mess.Region), ou->mess.Region,
+                       (int)sizeof(ou->mess.Zone), ou->mess.Zone, (int)sizeof(ou->mess.Rack), ou->mess.Rack);
+        }
 
         ap_rprintf(r, ",Flushpackets: %s,Flushwait: %d,Ping: %d,Smax: %d,Ttl: %d", flush_to_str(ou->mess.flushpackets),
                    ou->mess.flushwait, (int)ou->mess.ping, ou->mess.smax, (int)ou->mess.ttl);
 
         print_proxystat(r, mconf->reduce_display, ou);
+        print_load_metrics(r, ou);
     }
 
-    if (sizesessionid) {
-        ap_rprintf(r, ",Num sessions: %d", count_sessionid(r, ou->mess.JVMRoute));
+    if (sessions) {
+        ap_rprintf(r, ",Num sessions: %d", count_sessionid(sessions, ou->mess.JVMRoute));
     }
     ap_rprintf(r, "\n");
 }
@@ -3239,7 +4185,7 @@ static const char *process_params(request_rec *r, apr_table_t *params, int allow
         return NULL;
     }
 
-    /* Process INFO and DUMP */
+    /* Process INFO, DUMP and JSON */
     if (strcasecmp(cmd, "DUMP") == 0) {
         errstring = process_dump(r, &errtype);
         if (!errstring) {
@@ -3250,6 +4196,11 @@ static const char *process_params(request_rec *r, apr_table_t *params, int allow
         if (!errstring) {
             return cmd;
         }
+    } else if (strcasecmp(cmd, "JSON") == 0) {
+        errstring = process_json(r, &errtype);
+        if (!errstring) {
+            return cmd;
+        }
     }
     if (errstring) {
         process_error(r, errstring, errtype);
@@ -3333,6 +4284,7 @@ static void print_nodes(request_rec *r, const mod_manager_config *mconf, int siz
     int *ids;
     int i, nbnodes;
     nodeinfo_t *nodes;
+    apr_hash_t *sessions = sizesessionid ? count_sessionids(r) : NULL;
 
     ids = apr_palloc(r->pool, sizeof(int) * size);
     size = get_ids_used_node(nodestatsmem, ids);
@@ -3352,7 +4304,7 @@ static void print_nodes(request_rec *r, const mod_manager_config *mconf, int siz
     /* Print the ordered nodes */
     for (i = 0; i < size; i++) {
         nodeinfo_t *ou = &nodes[i];
-        print_node(r, &nodes[i], mconf, sizesessionid);
+        print_node(r, &nodes[i], mconf, sessions);
         /* Process the Vhosts */
         print_hosts(r, mconf->reduce_display, mconf->allow_cmd, ou->mess.id, ou->mess.JVMRoute);
     }
@@ -3406,7 +4358,7 @@ static int manager_info(request_rec *r)
     /* Process the parameters */
     if (r->args) {
         const char *cmd = process_params(r, params, mconf->allow_cmd, &errstring);
-        if (cmd && (strcasecmp(cmd, "INFO") == 0 || strcasecmp(cmd, "DUMP") == 0)) {
+        if (cmd && (strcasecmp(cmd, "INFO") == 0 || strcasecmp(cmd, "DUMP") == 0 || strcasecmp(cmd, "JSON") == 0)) {
             return OK;
         }
     }
@@ -3440,8 +4392,12 @@ static int manager_info(request_rec *r)
 static int manager_handler(request_rec *r)
 {
     apr_bucket_brigade *input_brigade;
-    char *buff, *errstring = NULL;
-    int errtype = 0;
+    apr_bucket *bucket;
+    mcmp_parser_t parser;
+    const char *clen;
+    apr_off_t length;
+    char *errstring = NULL;
+    int errtype = 0, eos = 0;
     apr_size_t bufsiz = 0, maxbufsiz, len;
     apr_status_t status;
     char **ptr;
@@ -3476,31 +4432,58 @@ static int manager_handler(request_rec *r)
     if (maxbufsiz < MAXMESSSIZE) {
         maxbufsiz = MAXMESSSIZE;
     }
-    buff = apr_pcalloc(r->pool, maxbufsiz);
+    /* Don't allocate more than the announced message */
+    clen = apr_table_get(r->headers_in, "Content-Length");
+    if (clen && apr_strtoff(&length, clen, NULL, 10) == APR_SUCCESS && length >= 0 && (apr_size_t)length < maxbufsiz) {
+        maxbufsiz = (apr_size_t)length;
+    }
+    mcmp_parser_init(&parser, r->pool, maxbufsiz);
     input_brigade = apr_brigade_create(r->pool, r->connection->bucket_alloc);
-    len = maxbufsiz;
-    while (APR_SUCCESS ==
-           (status = ap_get_brigade(r->input_filters, input_brigade, AP_MODE_READBYTES, APR_BLOCK_READ, len))) {
-        apr_brigade_flatten(input_brigade, buff + bufsiz, &len);
+    status = APR_SUCCESS;
+    while (bufsiz < maxbufsiz && !eos) {
+        status = ap_get_brigade(r->input_filters, input_brigade, AP_MODE_READBYTES, APR_BLOCK_READ,
+                                maxbufsiz - bufsiz);
+        if (status != APR_SUCCESS) {
+            break;
+        }
+        len = 0;
+        for (bucket = APR_BRIGADE_FIRST(input_brigade); bucket != APR_BRIGADE_SENTINEL(input_brigade);
+             bucket = APR_BUCKET_NEXT(bucket)) {
+            const char *data;
+            apr_size_t datalen;
+            if (APR_BUCKET_IS_EOS(bucket)) {
+                eos = 1;
+                break;
+            }
+            if (APR_BUCKET_IS_METADATA(bucket)) {
+                continue;
+            }
+            status = apr_bucket_read(bucket, &data, &datalen, APR_BLOCK_READ);
+            if (status != APR_SUCCESS) {
+                break;
+            }
+            if (datalen > maxbufsiz - bufsiz - len) {
+                datalen = maxbufsiz - bufsiz - len;
+            }
+            mcmp_parser_feed(&parser, data, datalen);
+            len += datalen;
+        }
         apr_brigade_cleanup(input_brigade);
         bufsiz += len;
-        if (bufsiz >= maxbufsiz || len == 0) {
+        if (status != APR_SUCCESS || len == 0) {
             break;
         }
-        len = maxbufsiz - bufsiz;
     }
 
     if (status != APR_SUCCESS) {
         process_error(r, apr_psprintf(r->pool, SREADER, r->method), TYPESYNTAX);
         return HTTP_INTERNAL_SERVER_ERROR;
     }
-    buff[bufsiz] = '\0';
 
-    /* XXX: Size limit it? */
-    ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, r->server, "manager_handler: %s (%s) processing: \"%s\"", r->method,
-                 r->filename, buff);
+    ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, r->server,
+                 "manager_handler: %s (%s) processing: %" APR_SIZE_T_FMT " bytes", r->method, r->filename, bufsiz);
 
-    ptr = process_buff(r, buff);
+    ptr = mcmp_parser_end(&parser);
     if (ptr == NULL) {
         process_error(r, SMESPAR, TYPESYNTAX);
         return HTTP_INTERNAL_SERVER_ERROR;
@@ -3512,8 +4495,14 @@ static int manager_handler(request_rec *r)
     } else if (strcasecmp(r->method, "STATUS") == 0) {
         errstring = process_status(r, (const char *const *)ptr, &errtype);
     } else if (strcasecmp(r->method, "DUMP") == 0) {
+        if (is_not_modified(r, 0)) {
+            return HTTP_NOT_MODIFIED;
+        }
         errstring = process_dump(r, &errtype);
     } else if (strcasecmp(r->method, "INFO") == 0) {
+        if (is_not_modified(r, 1)) {
+            return HTTP_NOT_MODIFIED;
+        }
         errstring = process_info(r, &errtype);
     } else if (strcasecmp(r->method, "PING") == 0) {
         errstring = process_ping(r, (const char *const *)ptr, &errtype);
@@ -3872,6 +4861,66 @@ static const char *cmd_manager_ajp_secret(cmd_parms *cmd, void *mconfig, const c
     return "AJPsecret requires mod_proxy_ajp.c";
 }
 
+static const char *cmd_manager_slowstart(cmd_parms *cmd, void *mconfig, const char *word)
+{
+    mod_manager_config *mconf = ap_get_module_config(cmd->server->module_config, &manager_module);
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+    int s = atoi(word);
+    (void)mconfig;
+
+    if (err != NULL) {
+        return err;
+    }
+    if (s < 0) {
+        return "SlowStart must be greater than 0 seconds, or 0 for no slow-start.";
+    }
+    mconf->slow_start = s;
+    return NULL;
+}
+
+static const char *cmd_manager_coalescetime(cmd_parms *cmd, void *mconfig, const char *word)
+{
+    mod_manager_config *mconf = ap_get_module_config(cmd->server->module_config, &manager_module);
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+    int ms = atoi(word);
+    (void)mconfig;
+
+    if (err != NULL) {
+        return err;
+    }
+    if (ms < 0) {
+        return "UpdateCoalesceTime must be greater than 0 milliseconds, or 0 to update the workers at once.";
+    }
+    mconf->coalesce_time = apr_time_from_msec(ms);
+    return NULL;
+}
+
+static const char *cmd_manager_metricweight(cmd_parms *cmd, void *mconfig, const char *word, const char *value)
+{
+    mod_manager_config *mconf = ap_get_module_config(cmd->server->module_config, &manager_module);
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+    int w = atoi(value);
+    int i;
+    (void)mconfig;
+
+    if (err != NULL) {
+        return err;
+    }
+    for (i = 0; i < LOAD_METRICS; i++) {
+        if (strcasecmp(word, load_metrics[i]) == 0) {
+            break;
+        }
+    }
+    if (i == LOAD_METRICS) {
+        return "LoadMetricWeight must be followed by Cpu, Heap, Queue or Threads";
+    }
+    if (w < 0) {
+        return "LoadMetricWeight must be greater than 0, or 0 to ignore the metric";
+    }
+    mconf->metric_weights[i] = w;
+    return NULL;
+}
+
 static const char *cmd_manager_responsefieldsize(cmd_parms *cmd, void *mconfig, const char *word)
 {
     mod_manager_config *mconf = ap_get_module_config(cmd->server->module_config, &manager_module);
@@ -3937,6 +4986,15 @@ static const command_rec manager_cmds[] = {
                   "AJPSecret - secret for all mod_cluster node, not configued no secret."),
     AP_INIT_TAKE1("ResponseFieldSize", cmd_manager_responsefieldsize, NULL, OR_ALL,
                   "ResponseFieldSize - Adjust the size of the proxy response field buffer."),
+    AP_INIT_TAKE1("SlowStart", cmd_manager_slowstart, NULL, OR_ALL,
+                  "SlowStart - Default time in seconds to ramp up the load factor of new or re-enabled nodes, the "
+                  "SlowStart field of the CONFIG message overrides it for its balancer (Default: 0 no slow-start)"),
+    AP_INIT_TAKE1("UpdateCoalesceTime", cmd_manager_coalescetime, NULL, OR_ALL,
+                  "UpdateCoalesceTime - Time in milliseconds during which the changes of the nodes are combined before "
+                  "the workers are updated, useful when many nodes register together (Default: 0 update at once)"),
+    AP_INIT_TAKE2("LoadMetricWeight", cmd_manager_metricweight, NULL, OR_ALL,
+                  "LoadMetricWeight - Weight of the Cpu, Heap, Queue or Threads metric of STATUS when it is combined "
+                  "with Load into the load factor of the node (Default: 1)"),
     {.name = NULL}
 };
 /* clang-format on */
@@ -3981,6 +5039,7 @@ static void manager_hooks(apr_pool_t *p)
 static void *create_manager_config(apr_pool_t *p)
 {
     mod_manager_config *mconf = apr_pcalloc(p, sizeof(*mconf));
+    int i;
 
     mconf->basefilename = NULL;
     mconf->maxcontext = DEFMAXCONTEXT;
@@ -3988,6 +5047,7 @@ static void *create_manager_config(apr_pool_t *p)
     mconf->maxhost = DEFMAXHOST;
     mconf->maxsessionid = DEFMAXSESSIONID;
     mconf->tableversion = 0;
+    mconf->tableupdated = 0;
     mconf->persistent = 0;
     mconf->nonce = -1;
     mconf->balancername = NULL;
@@ -3999,6 +5059,11 @@ static void *create_manager_config(apr_pool_t *p)
     mconf->ws_upgrade_header = NULL;
     mconf->ajp_secret = NULL;
     mconf->response_field_size = 0;
+    mconf->slow_start = 0;
+    mconf->coalesce_time = 0;
+    for (i = 0; i < LOAD_METRICS; i++) {
+        mconf->metric_weights[i] = -1;
+    }
     return mconf;
 }
 
@@ -4013,6 +5078,7 @@ static void *merge_manager_server_config(apr_pool_t *p, void *server1_conf, void
     mod_manager_config *mconf1 = (mod_manager_config *)server1_conf;
     mod_manager_config *mconf2 = (mod_manager_config *)server2_conf;
     mod_manager_config *mconf = (mod_manager_config *)create_manager_config(p);
+    int i;
 
     if (mconf2->basefilename) {
         mconf->basefilename = apr_pstrdup(p, mconf2->basefilename);
@@ -4110,6 +5176,26 @@ static void *merge_manager_server_config(apr_pool_t *p, void *server1_conf, void
         mconf->response_field_size = mconf1->response_field_size;
     }
 
+    if (mconf2->slow_start != 0) {
+        mconf->slow_start = mconf2->slow_start;
+    } else if (mconf1->slow_start != 0) {
+        mconf->slow_start = mconf1->slow_start;
+    }
+
+    if (mconf2->coalesce_time != 0) {
+        mconf->coalesce_time = mconf2->coalesce_time;
+    } else if (mconf1->coalesce_time != 0) {
+        mconf->coalesce_time = mconf1->coalesce_time;
+    }
+
+    for (i = 0; i < LOAD_METRICS; i++) {
+        if (mconf2->metric_weights[i] != -1) {
+            mconf->metric_weights[i] = mconf2->metric_weights[i];
+        } else if (mconf1->metric_weights[i] != -1) {
+            mconf->metric_weights[i] = mconf1->metric_weights[i];
+        }
+    }
+
     return mconf;
 }
 
@@ -24,8 +24,12 @@
 
 #if APR_HAS_THREADS
 #include "apr_thread_pool.h"
+#include "apr_thread_mutex.h"
+#include "apr_thread_cond.h"
 #endif
 
+#include "apr_atomic.h"
+
 /* define OUR load balancer method names (lbpname), must start by MC */
 /* default behaviour be sticky StickySession="yes" */
 #define MC_STICKY         "MC"
@@ -55,6 +59,24 @@ struct proxy_cluster_helper
 };
 typedef struct proxy_cluster_helper proxy_cluster_helper;
 
+/* Worker used by the previous request of a client connection (ConnectionAffinity) */
+struct proxy_cluster_conn
+{
+    char balancer[PROXY_BALANCER_MAX_NAME_SIZE];
+    char route[JVMROUTESZ];
+};
+typedef struct proxy_cluster_conn proxy_cluster_conn;
+
+/* Response time of the backend for the EWMA (stored in the request_config) */
+struct proxy_cluster_timing
+{
+    apr_time_t start; /* the worker was elected */
+    apr_time_t first; /* the first part of the response was sent to the client, 0 before */
+};
+typedef struct proxy_cluster_timing proxy_cluster_timing;
+
+module AP_MODULE_DECLARE_DATA proxy_cluster_module;
+
 typedef struct watchdog_thread_args
 {
     proxy_worker *worker;
@@ -89,6 +111,16 @@ static int creat_bal = CREAT_ROOT;
 
 static int use_alias = 0; /* 1 : Compare Alias with server_name */
 static int deterministic_failover = 0;
+
+#define BALANCE_BYREQUESTS  0 /* elected requests in the LBstatusRecalTime interval weighted by the lbfactor */
+#define BALANCE_OUTSTANDING 1 /* requests in flight (all children) weighted by the lbfactor */
+#define BALANCE_PEAK_EWMA   2 /* peak EWMA of the response time times the requests in flight weighted by the lbfactor */
+static int balancing_mode = BALANCE_BYREQUESTS;
+
+#define EWMA_SHIFT   3       /* min weight of a new sample in the EWMA: 1/8 */
+#define EWMA_DECAY   10000   /* the response time EWMA of a node without samples halves in 10 seconds */
+#define EWMA_ERROR   1000000 /* error sample (parts per million) */
+#define EWMA_PENALTY 10      /* an error rate of 10% doubles the response time of the node */
 static int use_nocanon = 0;
 static int responsecode_when_no_context = HTTP_NOT_FOUND;
 
@@ -119,11 +151,113 @@ static APR_OPTIONAL_FN_TYPE(set_worker_hc_param) *set_worker_hc_param_f = NULL;
 /* To stop the watchdog loop */
 static int child_stopping = 0;
 
-static int proxy_worker_cmp(const void *a, const void *b)
+/* STATUS uses the result of a ping/pong younger than that and refreshes it in background, 0: ping for each STATUS */
+static apr_time_t status_ping_interval = 0;
+
+/* String form of the context ids for BALANCER_CONTEXT_ID, filled in child_init() */
+static const char **context_id_strings = NULL;
+static int context_id_count = 0;
+
+/* Passive outlier detection (OutlierDetection), a 0 value disables the corresponding check */
+static int outlier_detection = 0;
+static int outlier_consecutive = 5;   /* consecutive failed requests */
+static int outlier_rate = 0;          /* percentage of failed requests in the window */
+static int outlier_min_requests = 10; /* requests in the window needed to check the rate */
+static int outlier_max_ejected = 50;  /* max percentage of ejected nodes in a balancer */
+static apr_time_t outlier_window = apr_time_from_sec(10);
+static apr_time_t outlier_ejection = apr_time_from_sec(30); /* doubled for each consecutive ejection */
+#define OUTLIER_MAX_SHIFT 6 /* ejection time is at most 64 times outlier_ejection */
+
+/* Circuit breaker of the nodes (CircuitBreakerTrials), 0 trials disables it */
+#define CIRCUIT_CLOSED            0  /* normal traffic */
+#define CIRCUIT_OPEN              1  /* the node is in error: no traffic */
+#define CIRCUIT_HALF_OPEN         2  /* the node is usable again: only trial requests until they all succeed */
+#define CIRCUIT_HALF_OPEN_TIMEOUT 60 /* seconds before a half-open circuit with all its trials pending opens again */
+#define CIRCUIT_MAX_RETRIES       3  /* selections retried when the elected node has no more trials */
+static apr_uint32_t circuit_trials = 0;
+
+/* Retry budget (RetryBudget): failover attempts allowed in percentage of the requests, 0: no budget */
+static apr_uint32_t retry_budget = 0;
+#define RETRY_MAX_TOKENS (10 * 100) /* a quiet period saves at most 10 failover attempts */
+/* in hundredths of a failover attempt, a new child starts with a full budget */
+static apr_uint32_t retry_tokens = RETRY_MAX_TOKENS;
+
+/* Locality aware failover: locality of the proxy (ProxyLocality) and of the nodes (Region/Zone/Rack in CONFIG) */
+typedef struct locality
+{
+    const char *region;
+    const char *zone;
+    const char *rack;
+} locality_t;
+static locality_t proxy_locality = {NULL, NULL, NULL};
+static int locality_spillover = 0; /* LocalitySpillover: extra load percentage per tier before spilling, 0: never */
+
+/* Overflow to the standby nodes (StandbyOverflow), a 0 value disables the corresponding check */
+static int standby_overflow = 0;
+static int standby_utilization = 0;    /* percentage of busy/smax of the elected primary node */
+static apr_time_t standby_latency = 0; /* EWMA response time of the elected primary node */
+#define STANDBY_UTILIZATION 80 /* utilization of StandbyOverflow On */
+
+/* Send the requests without session of a client connection to the same worker */
+static int connection_affinity = 0;
+
+/* Smoothing of the load factors of STATUS (LoadSmoothing) */
+static int load_smoothing = 0;
+static int load_smoothing_weight = 50; /* percentage of the new load in the EWMA */
+static int load_max_delta = 0;         /* max change of the load factor per STATUS, 0: no limit */
+
+/* Break the ties between equally loaded nodes in a random order drawn for each request (RandomTieBreak) */
+static int random_tie_break = 0;
+
+/* Bounded load (BoundedLoad): max load of a node in percentage above its share of the requests, 0: no bound */
+static int bounded_load = 0;
+static int bounded_load_redirect = 0; /* also redirect the sticky requests of overloaded nodes */
+
+/* Admission control (ContextMaxRequests): max active requests of a context on a node */
+#define CONTEXT_MAX_AUTO -1          /* derived from the node smax and the lbfactor */
+static int context_max_requests = 0; /* 0: no limit */
+
+#if APR_HAS_THREADS
+/* Requests waiting for a worker (balancer timeout), woken when a worker is released or the nodes are checked */
+typedef struct waitqueue_entry
+{
+    const proxy_balancer *balancer;
+    int context; /* id of the full context the request waits for, -1: all the workers are busy */
+    int sticky;  /* requests with a session route are queued before the new sessions */
+    struct waitqueue_entry *next;
+    struct waitqueue_entry *prev;
+} waitqueue_entry_t;
+
+static apr_thread_mutex_t *waitqueue_mutex = NULL;
+static apr_thread_cond_t *waitqueue_cond = NULL;
+static waitqueue_entry_t *waitqueue_first = NULL;
+static waitqueue_entry_t *waitqueue_last = NULL;
+static apr_uint32_t waitqueue_length = 0;
+static apr_uint32_t waitqueue_max = 0; /* 0: no limit */
+#endif
+
+/*
+ * Rendezvous (highest random weight) score of a route for a session id: the worker with the highest
+ * score gets the session, so only the sessions of a node that leaves (or joins) the cluster move.
+ * FNV-1a over the session id and the route followed by a finalizer to spread the bits.
+ */
+static unsigned int rendezvous_score(const char *session_id, apr_size_t len, const char *route)
 {
-    const char *route1 = (*(proxy_worker **)a)->s->route;
-    const char *route2 = (*(proxy_worker **)b)->s->route;
-    return strcmp(route1, route2);
+    unsigned int hash = 2166136261U;
+    apr_size_t i;
+
+    for (i = 0; i < len; i++) {
+        hash = (hash ^ (unsigned char)session_id[i]) * 16777619U;
+    }
+    for (; *route; route++) {
+        hash = (hash ^ (unsigned char)*route) * 16777619U;
+    }
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bU;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35U;
+    hash ^= hash >> 16;
+    return hash;
 }
 
 /* Compare proxy host with node host */
@@ -1208,7 +1342,11 @@ static void mc_watchdog_targs_destroy(apr_thread_t *thread, watchdog_thread_args
     }
 }
 
-static void *APR_THREAD_FUNC check_proxy_worker(apr_thread_t *thread, void *data)
+/*
+ * Do a ping/pong to the worker outside of a client request (watchdog and STATUS probes)
+ */
+static apr_status_t ping_proxy_worker(proxy_worker *worker, proxy_server_conf *conf, server_rec *server,
+                                      apr_pool_t *pool)
 {
     apr_status_t rv;
     char sport[7];
@@ -1216,16 +1354,6 @@ static void *APR_THREAD_FUNC check_proxy_worker(apr_thread_t *thread, void *data
     apr_pool_t *rrp;
     request_rec *rnew;
 
-    watchdog_thread_args_t *targs = (watchdog_thread_args_t *)data;
-    proxy_worker *worker = targs->worker;
-    apr_pool_t *pool = targs->pool;
-    proxy_server_conf *conf = targs->conf;
-    nodeinfo_t *ou = targs->ou;
-    server_rec *server = targs->server;
-    apr_time_t now = targs->now;
-    int id = targs->id;
-
-    (void)thread;
     apr_snprintf(sport, sizeof(sport), "%d", worker->s->port);
 
     if (strchr(worker->s->hostname, ':') != NULL) {
@@ -1252,6 +1380,22 @@ static void *APR_THREAD_FUNC check_proxy_worker(apr_thread_t *thread, void *data
     rnew->headers_in = apr_table_make(rnew->pool, 1);
     rv = proxy_cluster_try_pingpong(rnew, worker, url, conf);
     apr_pool_destroy(rrp);
+    return rv;
+}
+
+static void *APR_THREAD_FUNC check_proxy_worker(apr_thread_t *thread, void *data)
+{
+    apr_status_t rv;
+
+    watchdog_thread_args_t *targs = (watchdog_thread_args_t *)data;
+    proxy_worker *worker = targs->worker;
+    proxy_server_conf *conf = targs->conf;
+    nodeinfo_t *ou = targs->ou;
+    server_rec *server = targs->server;
+    apr_time_t now = targs->now;
+    int id = targs->id;
+
+    rv = ping_proxy_worker(worker, conf, server, targs->pool);
 
     /* We have checked the worker... check if we were told to stop */
     if (child_stopping) {
@@ -1287,6 +1431,95 @@ static void *APR_THREAD_FUNC check_proxy_worker(apr_thread_t *thread, void *data
     return APR_SUCCESS;
 }
 
+#if MC_USE_THREADS
+/*
+ * Background ping/pong for STATUS: record the result for the next STATUS messages of the node
+ */
+static void *APR_THREAD_FUNC probe_proxy_worker(apr_thread_t *thread, void *data)
+{
+    apr_status_t rv;
+    watchdog_thread_args_t *targs = (watchdog_thread_args_t *)data;
+    nodeinfo_t *ou;
+
+    ap_assert(node_storage->lock_nodes() == APR_SUCCESS);
+    if (read_node_worker(targs->id, &ou, targs->worker) == APR_SUCCESS) {
+        targs->worker->s->error_time = 0; /* Force retry now */
+    }
+    node_storage->unlock_nodes();
+
+    rv = ping_proxy_worker(targs->worker, targs->conf, targs->server, targs->pool);
+
+    ap_assert(node_storage->lock_nodes() == APR_SUCCESS);
+    if (read_node_worker(targs->id, &ou, targs->worker) == APR_SUCCESS) {
+        ou->mess.probetime = apr_time_now();
+        ou->mess.probeok = rv == APR_SUCCESS;
+        if (rv != APR_SUCCESS) {
+            targs->worker->s->status |= PROXY_WORKER_IN_ERROR;
+        } else {
+            targs->worker->s->status &= ~PROXY_WORKER_IN_ERROR;
+        }
+    }
+    if (node_storage->read_node(targs->id, &ou) == APR_SUCCESS) {
+        apr_atomic_set32(&ou->mess.probing, 0);
+    }
+    node_storage->unlock_nodes();
+    mc_watchdog_targs_destroy(thread, targs);
+
+    return APR_SUCCESS;
+}
+#endif
+
+/*
+ * Check if STATUS can use the last ping/pong result of the node: it is younger than status_ping_interval.
+ * Past half of the interval a background ping/pong (only one per node) refreshes it before it expires.
+ * Return 0 if the caller must do the ping/pong: no result yet or the result expired.
+ */
+static int status_probe_cached(proxy_worker *worker, proxy_server_conf *conf, nodeinfo_t *node, int id)
+{
+#if MC_USE_THREADS
+    apr_pool_t *targs_pool;
+    watchdog_thread_args_t *targs;
+    apr_interval_time_t age;
+
+    if (node->mess.probetime == 0) {
+        return 0; /* no result yet */
+    }
+    age = apr_time_now() - node->mess.probetime;
+    if (age >= status_ping_interval) {
+        return 0; /* expired, don't answer with a stale result */
+    }
+    if (age < status_ping_interval / 2) {
+        return 1;
+    }
+    if (apr_atomic_cas32(&node->mess.probing, 1, 0) != 0) {
+        return 1; /* already in flight */
+    }
+    if (mc_thread_pool) {
+        apr_pool_create(&targs_pool, main_server->process->pool);
+        apr_pool_tag(targs_pool, "mc_status_probe");
+        targs = apr_pcalloc(targs_pool, sizeof(watchdog_thread_args_t));
+        targs->server = main_server;
+        targs->pool = targs_pool;
+        targs->conf = conf;
+        targs->worker = worker;
+        targs->id = id;
+        if (apr_thread_pool_push(mc_thread_pool, probe_proxy_worker, targs, APR_THREAD_TASK_PRIORITY_HIGHEST, NULL) ==
+            APR_SUCCESS) {
+            return 1;
+        }
+        apr_pool_destroy(targs_pool);
+    }
+    apr_atomic_set32(&node->mess.probing, 0);
+    return 1; /* still younger than the interval, the next STATUS retries the refresh */
+#else
+    (void)worker;
+    (void)conf;
+    (void)node;
+    (void)id;
+#endif
+    return 0;
+}
+
 /*
  * NOTE: node_storage must be locked!
  */
@@ -1583,186 +1816,787 @@ static int isnode_domain_ok(const request_rec *r, const nodeinfo_t *node, const
     return 0;
 }
 
-static proxy_worker *internal_process_worker(proxy_worker *worker, int checking_standby, int checked_domain,
-                                             const char *domain, const node_context *best,
-                                             const node_context **mynodecontext, const request_rec *r,
-                                             proxy_worker **mycandidate, nodeinfo_t **node1, const char *balancer_name)
+/*
+ * Add a sample to an EWMA stored in the shared memory, without lock: if another child or thread changed
+ * the value in between we just retry. With a stamp the weight of the sample grows with the time elapsed
+ * since the previous one (half after EWMA_DECAY ms), so the value follows the last samples of a node that
+ * gets few requests. With peak the first sample and the samples above the value are taken as they are
+ * and the value decays afterwards, so a node that slows down is avoided immediately.
+ */
+static void update_ewma(apr_uint32_t *ewma, apr_uint32_t *stamp, apr_uint32_t sample, int peak)
 {
-    nodeinfo_t *node;
-    const node_context *best1;
-    proxy_cluster_helper *helper = (proxy_cluster_helper *)worker->context;
-
-    if (!worker->s || !worker->context) {
-        ap_log_error(APLOG_MARK, APLOG_ERR, 0, r->server,
-                     "find_session_route: byrequests balancer %s skipping BAD worker %s", balancer_name,
-#ifdef PROXY_WORKER_EXT_NAME_SIZE
-                     worker->s ? worker->s->name_ex : "NULL");
-#else
-                     worker->s ? worker->s->name : "NULL");
-#endif
-        return NULL;
-    }
-    if (worker->s->index == -1) {
-        ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, r->server,
-                     "find_session_route: byrequests balancer skipping REMOVED worker");
-        return NULL; /* marked removed */
-    }
-    if (helper->index != worker->s->index) {
-        /* something is very bad */
-        ap_log_error(
-            APLOG_MARK, APLOG_ERR, 0, r->server,
-            "find_session_route: byrequests balancer skipping BAD worker (helper->index: %d, worker->s->index: %d)",
-            helper->index, worker->s->index);
-        return NULL; /* probably used by different worker */
+    apr_uint32_t old, new;
+    apr_uint64_t weight = 1000 >> EWMA_SHIFT; /* per thousand */
+
+    if (stamp) {
+        apr_uint32_t now = (apr_uint32_t)apr_time_as_msec(apr_time_now());
+        apr_uint64_t elapsed = now - apr_atomic_xchg32(stamp, now);
+        if ((elapsed * 1000) / (elapsed + EWMA_DECAY) > weight) {
+            weight = (elapsed * 1000) / (elapsed + EWMA_DECAY);
+        }
     }
+    do {
+        old = apr_atomic_read32(ewma);
+        if (peak && (old == 0 || sample > old)) {
+            new = sample;
+        } else {
+            new = (apr_uint32_t)(((apr_uint64_t)old * (1000 - weight) + (apr_uint64_t)sample * weight) / 1000);
+        }
+    } while (apr_atomic_cas32(ewma, new, old) != old);
+}
 
-    ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, r->server,
-                 "find_session_route: worker %d name: %s lbfactor: %d checking_standby: %d", worker->s->index,
-#ifdef PROXY_WORKER_EXT_NAME_SIZE
-                 worker->s->name_ex, worker->s->lbfactor, checking_standby);
-#else
-                 worker->s->name, worker->s->lbfactor, checking_standby);
-#endif
-
-    /* standby logic
-     * lbfactor: -1 broken node.
-     *            0 standby.
-     *           >0 factor to use.
-     */
-    if (worker->s->lbfactor < 0 || (worker->s->lbfactor == 0 && !checking_standby)) {
-        return NULL;
-    }
+/*
+ * Response time EWMA of the node decayed by the time elapsed since its last sample, so a node avoided
+ * because of a slow response gets requests again.
+ */
+static apr_uint64_t ewma_time_decayed(const nodeinfo_t *node)
+{
+    apr_uint64_t elapsed = (apr_uint32_t)apr_time_as_msec(apr_time_now()) - node->mess.ewma_stamp;
 
-    /* If the worker is in error state the STATUS logic will retry it */
-    if (!PROXY_WORKER_IS_USABLE(worker)) {
-        return NULL;
-    }
+    return (node->mess.ewma_time * (apr_uint64_t)EWMA_DECAY) / (elapsed + EWMA_DECAY);
+}
 
-    /* Take into calculation only the workers that are
-     * not in error state or not disabled.
-     * and that can map the context.
-     */
-    if (best == NULL) {
-        apr_table_setn(r->subprocess_env, "BALANCER_CONTEXT_ID", "");
-        ap_log_error(APLOG_MARK, APLOG_ERR, 0, r->server, "find_session_route: byrequests balancer FAILED");
-        return NULL;
-    }
-    best1 = best;
+/*
+ * Load factor of the worker, reduced while the node is in its slow-start window: it grows linearly
+ * from 1/10 to the full lbfactor so the children don't flood a node that has just been added or re-enabled.
+ */
+static int effective_lbfactor(const proxy_worker *worker, const nodeinfo_t *node)
+{
+    apr_time_t elapsed;
+    int lbfactor;
 
-    while (best1->node != -1) {
-        if (best1->node == worker->s->index) {
-            break;
-        }
-        best1++;
+    if (node->mess.slowstart <= 0) {
+        return worker->s->lbfactor;
     }
-    if (best1->node == -1) {
-        return NULL; /* not found */
+    elapsed = apr_time_now() - node->mess.rampstart;
+    if (elapsed >= node->mess.slowstart || elapsed < 0) {
+        return worker->s->lbfactor;
     }
+    lbfactor = (int)((worker->s->lbfactor * (node->mess.slowstart + 9 * elapsed)) / (10 * node->mess.slowstart));
+    return lbfactor > 0 ? lbfactor : 1;
+}
 
-    /* Let's do the table read only now after we know the worker is usable and matches */
-    if (read_node_worker(worker->s->index, &node, worker) != APR_SUCCESS) {
-        return NULL; /* Can't read node */
-    }
-    if (worker->s != (proxy_worker_shared *)((char *)node + NODEOFFSET)) {
-        return NULL; /* wrong shared memory address */
-    }
+/*
+ * Cost of a worker for the peak EWMA logic: response time (increased by the error rate) times the
+ * requests in flight + 1, weighted by the lbfactor.
+ */
+static apr_uint64_t peak_ewma_cost(const proxy_worker *worker, const nodeinfo_t *node, int lbfactor)
+{
+    apr_uint64_t time = ewma_time_decayed(node);
 
-    /* First try only nodes in the domain */
-    if (!checked_domain && !isnode_domain_ok(r, node, domain)) {
-        return NULL;
-    }
+    time += (time * node->mess.ewma_errors * EWMA_PENALTY) / EWMA_ERROR;
+    return (time * (worker->s->busy + 1) * 100) / lbfactor;
+}
 
-    if (worker->s->lbfactor == 0 && checking_standby) {
-        *mycandidate = worker;
-        *mynodecontext = best1;
-        return worker; /* Done */
-    }
+/*
+ * Compare the load of two workers (both with lbfactor > 0 or both standby, then weighted the same).
+ * Returns > 0 if worker1 is more loaded than worker2, < 0 if less and 0 if they are equal.
+ */
+static int worker_load_cmp(const proxy_worker *worker1, const nodeinfo_t *node1, const proxy_worker *worker2,
+                           const nodeinfo_t *node2)
+{
+    int lbfactor1 = effective_lbfactor(worker1, node1);
+    int lbfactor2 = effective_lbfactor(worker2, node2);
+    int lbstatus1, lbstatus2;
 
-    if (!(*mycandidate)) {
-        *mycandidate = worker;
-        *mynodecontext = best1;
-        *node1 = node;
-        return worker;
+    if (lbfactor1 <= 0 || lbfactor2 <= 0) {
+        lbfactor1 = lbfactor2 = 1;
     }
 
-    /* Let's avoid repeat reads of mycandidate through our loop iterations */
-    if (!(*node1) && node_storage->read_node((*mycandidate)->s->index, node1) != APR_SUCCESS) {
-        *mycandidate = NULL;
-        return worker;
+    if (balancing_mode == BALANCE_PEAK_EWMA && node1->mess.ewma_time && node2->mess.ewma_time) {
+        apr_uint64_t cost1 = peak_ewma_cost(worker1, node1, lbfactor1);
+        apr_uint64_t cost2 = peak_ewma_cost(worker2, node2, lbfactor2);
+        if (cost1 != cost2) {
+            return cost1 > cost2 ? 1 : -1;
+        }
     }
 
-    if ((*mycandidate)->s->lbfactor > 0 && worker->s->lbfactor) {
-        int lbstatus1 =
-            (((*mycandidate)->s->elected - (*node1)->mess.oldelected) * 1000) / (*mycandidate)->s->lbfactor +
-            (*mycandidate)->s->lbstatus;
-        int lbstatus =
-            ((worker->s->elected - node->mess.oldelected) * 1000) / worker->s->lbfactor + worker->s->lbstatus;
-        if (lbstatus1 > lbstatus) {
-            *mycandidate = worker;
-            *mynodecontext = best1;
+    if (balancing_mode != BALANCE_BYREQUESTS) {
+        /* busy is in the shared memory, so it counts the requests in flight of all the children */
+        apr_size_t outstanding1 = (worker1->s->busy * 1000) / lbfactor1;
+        apr_size_t outstanding2 = (worker2->s->busy * 1000) / lbfactor2;
+        if (outstanding1 != outstanding2) {
+            return outstanding1 > outstanding2 ? 1 : -1;
         }
-    } else {
-        ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, r->server,
-                     "find_session_route: Could not recalculate lbstatus (candidate lbfactor: %d, worker lbfactor %d)",
-                     (*mycandidate)->s->lbfactor, worker->s->lbfactor);
+        /* same number of requests in flight, use the elected ones to spread the load */
     }
 
-    return worker;
+    lbstatus1 = ((worker1->s->elected - node1->mess.oldelected) * 1000) / lbfactor1 + worker1->s->lbstatus;
+    lbstatus2 = ((worker2->s->elected - node2->mess.oldelected) * 1000) / lbfactor2 + worker2->s->lbstatus;
+    return lbstatus1 - lbstatus2;
 }
 
 /*
- * The ModClusterService from the cluster fills the lbfactor values.
- * Our logic is a bit different the mod_balancer one. We check the
- * context and host to prevent to route to application beeing redeploy or
- * stopped in one node but not in others.
- * We also try the domain.
+ * Key of the worker in the random order of the equally loaded workers given by the draw of the request
  */
-static proxy_worker *internal_find_best_byrequests(const proxy_balancer *balancer, const proxy_server_conf *conf,
-                                                   request_rec *r, const char *domain, int failoverdomain,
-                                                   const proxy_vhost_table *vhost_table,
-                                                   const proxy_context_table *context_table,
-                                                   proxy_node_table *node_table)
+static apr_uint32_t tie_break_key(const proxy_worker *worker, apr_uint32_t tie_break)
 {
-    int i, hash = 0;
-    proxy_worker *mycandidate = NULL;
-    const node_context *mynodecontext = NULL;
-    node_context *best = NULL;
-    int checking_standby = 0;
-    int checked_standby = 0;
-    int checked_domain = 1;
-    /* Create a separate array of available workers, to be sorted later */
-    proxy_worker **workers = NULL;
-    int workers_length = 0;
-    const char *session_id_with_route;
-    const char *route;
-    char *tokenizer;
-    const char *session_id;
-    int has_contexts = 0;
+    apr_uint32_t key = ((apr_uint32_t)worker->s->index + 1) * 2654435761u ^ tie_break;
+    key ^= key >> 16;
+    key *= 0x85ebca6bu;
+    key ^= key >> 13;
+    key *= 0xc2b2ae35u;
+    key ^= key >> 16;
+    return key;
+}
 
-    workers = apr_pcalloc(r->pool, sizeof(proxy_worker *) * balancer->workers->nelts);
-    ap_log_error(APLOG_MARK, APLOG_TRACE4, 0, r->server,
-                 "internal_find_best_byrequests: Entering byrequests for CLUSTER (%s) failoverdomain:%d",
-                 balancer->s->name, failoverdomain);
+/*
+ * Order of the equally loaded workers for this request, so the requests don't all pick the same one.
+ */
+static int tie_break_cmp(const proxy_worker *worker1, const proxy_worker *worker2, apr_uint32_t tie_break)
+{
+    apr_uint32_t key1 = tie_break_key(worker1, tie_break);
+    apr_uint32_t key2 = tie_break_key(worker2, tie_break);
+    return key1 == key2 ? 0 : (key1 > key2 ? 1 : -1);
+}
 
-    /* create workers for new nodes */
-    if (!cache_share_for) {
-        ap_assert(node_storage->lock_nodes() == APR_SUCCESS);
-        update_workers_node(conf, r->pool, r->server, 1, node_table);
-        check_workers(conf, r->server);
-        node_storage->unlock_nodes();
+/*
+ * The worker is in error: open the circuit of its node. No trial is left while it is open, so a child
+ * that sees the circuit half-open before circuit_admit() reset the counters doesn't send one.
+ */
+static void circuit_open(const proxy_worker *worker)
+{
+    nodeinfo_t *node;
+
+    if (circuit_trials && read_node_worker(worker->s->index, &node, worker) == APR_SUCCESS) {
+        apr_atomic_set32(&node->mess.trials, circuit_trials);
+        apr_atomic_set32(&node->mess.circuit, CIRCUIT_OPEN);
     }
+}
 
-    /* do this once now to avoid repeating find_node_context_host through loop iterations */
-    route = apr_table_get(r->notes, "session-route");
-    best = find_node_context_host(r, balancer, route, use_alias, vhost_table, context_table, node_table, &has_contexts);
-    if (best == NULL) {
-        /* No context to serve the request we can't do much */
+/*
+ * A half-open circuit whose trial requests didn't all report back in time (lost results) goes back to open,
+ * the next request starts a new set of trials.
+ */
+static void circuit_expire(nodeinfo_t *node)
+{
+    apr_uint32_t now = (apr_uint32_t)apr_time_sec(apr_time_now());
+
+    if (apr_atomic_read32(&node->mess.circuit) == CIRCUIT_HALF_OPEN &&
+        apr_atomic_read32(&node->mess.trials) >= circuit_trials &&
+        now - apr_atomic_read32(&node->mess.halfopen) >= CIRCUIT_HALF_OPEN_TIMEOUT) {
+        apr_atomic_cas32(&node->mess.circuit, CIRCUIT_OPEN, CIRCUIT_HALF_OPEN);
+    }
+}
+
+/*
+ * Check (without changing anything but an expired half-open state) that the circuit of the node lets
+ * requests through.
+ */
+static int circuit_check(nodeinfo_t *node)
+{
+    if (!circuit_trials) {
+        return 1;
+    }
+    circuit_expire(node);
+    if (apr_atomic_read32(&node->mess.circuit) != CIRCUIT_HALF_OPEN) {
+        return 1; /* closed or open but the worker is usable again (half-open on the next request) */
+    }
+    return apr_atomic_read32(&node->mess.trials) < circuit_trials;
+}
+
+/*
+ * Admit the request on the (usable) worker chosen for it. An open circuit moves to half-open and in
+ * half-open only circuit_trials requests of all the children get through until their results are known.
+ * The trial requests are noted for proxy_cluster_post_request().
+ */
+static int circuit_admit(request_rec *r, const proxy_worker *worker)
+{
+    nodeinfo_t *node;
+    apr_uint32_t trials;
+
+    if (!circuit_trials || read_node_worker(worker->s->index, &node, worker) != APR_SUCCESS) {
+        return 1;
+    }
+    if (apr_atomic_read32(&node->mess.circuit) == CIRCUIT_CLOSED) {
+        return 1;
+    }
+    circuit_expire(node);
+    if (apr_atomic_read32(&node->mess.circuit) == CIRCUIT_OPEN &&
+        apr_atomic_cas32(&node->mess.circuit, CIRCUIT_HALF_OPEN, CIRCUIT_OPEN) == CIRCUIT_OPEN) {
+        /*
+         * Only the request that moved the circuit resets the counters, and it takes the first trial. Until then
+         * the trials left by circuit_open() tell the other children that no trial is available.
+         */
+        apr_atomic_set32(&node->mess.halfopen, (apr_uint32_t)apr_time_sec(apr_time_now()));
+        apr_atomic_set32(&node->mess.successes, 0);
+        apr_atomic_set32(&node->mess.trials, 1);
+        ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, r->server, "circuit_admit: node %s circuit half-open",
+                     node->mess.JVMRoute);
+        apr_table_setn(r->notes, "circuit-trial", "1");
+        return 1;
+    }
+    if (apr_atomic_read32(&node->mess.circuit) != CIRCUIT_HALF_OPEN) {
+        return 1;
+    }
+    do {
+        trials = apr_atomic_read32(&node->mess.trials);
+        if (trials >= circuit_trials) {
+            ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, r->server, "circuit_admit: node %s half-open, no more trials",
+                         node->mess.JVMRoute);
+            return 0;
+        }
+    } while (apr_atomic_cas32(&node->mess.trials, trials + 1, trials) != trials);
+    apr_table_setn(r->notes, "circuit-trial", "1");
+    return 1;
+}
+
+/*
+ * The request admitted as a trial request on the worker doesn't use it: give the trial back.
+ */
+static void circuit_release(request_rec *r, const proxy_worker *worker)
+{
+    nodeinfo_t *node;
+    apr_uint32_t trials;
+
+    if (!apr_table_get(r->notes, "circuit-trial")) {
+        return;
+    }
+    apr_table_unset(r->notes, "circuit-trial");
+    if (read_node_worker(worker->s->index, &node, worker) != APR_SUCCESS) {
+        return;
+    }
+    do {
+        trials = apr_atomic_read32(&node->mess.trials);
+        if (trials == 0 || apr_atomic_read32(&node->mess.circuit) != CIRCUIT_HALF_OPEN) {
+            return; /* the circuit opened again meanwhile, it keeps no trial left */
+        }
+    } while (apr_atomic_cas32(&node->mess.trials, trials - 1, trials) != trials);
+}
+
+/*
+ * Result of a trial request: close the circuit when all the trials succeeded, put the worker back
+ * in error (and open the circuit) on the first failure.
+ */
+static void circuit_result(request_rec *r, proxy_worker *worker, int failed)
+{
+    nodeinfo_t *node;
+
+    if (!apr_table_get(r->notes, "circuit-trial")) {
+        return;
+    }
+    apr_table_unset(r->notes, "circuit-trial"); /* a failover attempt is not a trial */
+    if (read_node_worker(worker->s->index, &node, worker) != APR_SUCCESS) {
+        return;
+    }
+    if (failed) {
+        worker->s->status |= PROXY_WORKER_IN_ERROR;
+        worker->s->error_time = apr_time_now();
+        apr_atomic_set32(&node->mess.trials, circuit_trials);
+        apr_atomic_set32(&node->mess.circuit, CIRCUIT_OPEN);
+        ap_log_error(APLOG_MARK, APLOG_WARNING, 0, r->server, "circuit_result: node %s trial failed, circuit open",
+                     node->mess.JVMRoute);
+    } else if (apr_atomic_inc32(&node->mess.successes) + 1 >= circuit_trials &&
+               apr_atomic_cas32(&node->mess.circuit, CIRCUIT_CLOSED, CIRCUIT_HALF_OPEN) == CIRCUIT_HALF_OPEN) {
+        ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, r->server, "circuit_result: node %s circuit closed",
+                     node->mess.JVMRoute);
+    }
+}
+
+/*
+ * Check that ejecting the node doesn't eject more than outlier_max_ejected percent of the nodes of its balancer.
+ * NOTE: the nodes are locked.
+ */
+static int outlier_can_eject(const nodeinfo_t *node, apr_time_t now, apr_pool_t *pool)
+{
+    int *ids, size, i;
+    int total = 0;
+    int ejected = 1; /* node */
+
+    size = node_storage->get_max_size_node();
+    if (size == 0) {
+        return 0;
+    }
+    ids = apr_palloc(pool, sizeof(int) * size);
+    size = node_storage->get_ids_used_node(ids);
+    for (i = 0; i < size; i++) {
+        nodeinfo_t *ou;
+        if (node_storage->read_node(ids[i], &ou) != APR_SUCCESS || ou->mess.remove ||
+            strcmp(ou->mess.balancer, node->mess.balancer)) {
+            continue;
+        }
+        total++;
+        if (ou != node && ou->mess.ejecteduntil > now) {
+            ejected++;
+        }
+    }
+    return ejected * 100 <= outlier_max_ejected * total;
+}
+
+/*
+ * Account the result of a request for the passive outlier detection and eject the node if it failed
+ * too many requests. The counts use two windows, the previous one weighted by the part of it that is
+ * still in the sliding window.
+ * NOTE: the nodes are locked.
+ */
+static void outlier_record(request_rec *r, nodeinfo_t *node, int failed)
+{
+    apr_time_t now = apr_time_now();
+    apr_time_t elapsed = now - node->mess.outlierstart;
+    apr_time_t ejection;
+    int requests, failures;
+    int shift = node->mess.ejections < OUTLIER_MAX_SHIFT ? node->mess.ejections : OUTLIER_MAX_SHIFT;
+
+    if (elapsed >= outlier_window || elapsed < 0) {
+        /* move to the next window */
+        if (elapsed >= 2 * outlier_window || elapsed < 0) {
+            node->mess.outlierrequests[1] = 0;
+            node->mess.outlierfailures[1] = 0;
+        } else {
+            node->mess.outlierrequests[1] = node->mess.outlierrequests[0];
+            node->mess.outlierfailures[1] = node->mess.outlierfailures[0];
+        }
+        node->mess.outlierrequests[0] = 0;
+        node->mess.outlierfailures[0] = 0;
+        node->mess.outlierstart = now;
+        elapsed = 0;
+    }
+
+    node->mess.outlierrequests[0]++;
+    if (!failed) {
+        node->mess.consecutivefailures = 0;
+        /* The node behaved long enough since its last ejection: forget about it */
+        if (node->mess.ejections && now > node->mess.ejecteduntil + (outlier_ejection << shift)) {
+            node->mess.ejections = 0;
+        }
+        return;
+    }
+    node->mess.outlierfailures[0]++;
+    node->mess.consecutivefailures++;
+
+    if (node->mess.ejecteduntil > now) {
+        return; /* already ejected */
+    }
+    requests = node->mess.outlierrequests[0] +
+               (int)((node->mess.outlierrequests[1] * (outlier_window - elapsed)) / outlier_window);
+    failures = node->mess.outlierfailures[0] +
+               (int)((node->mess.outlierfailures[1] * (outlier_window - elapsed)) / outlier_window);
+    if (!(outlier_consecutive && node->mess.consecutivefailures >= outlier_consecutive) &&
+        !(outlier_rate && requests >= outlier_min_requests && failures * 100 >= outlier_rate * requests)) {
+        return;
+    }
+
+    if (!outlier_can_eject(node, now, r->pool)) {
+        ap_log_error(APLOG_MARK, APLOG_WARNING, 0, r->server,
+                     "outlier_record: node %s not ejected, too many nodes of balancer %s are already ejected",
+                     node->mess.JVMRoute, node->mess.balancer);
+        return;
+    }
+    ejection = outlier_ejection << shift;
+    node->mess.ejecteduntil = now + ejection;
+    node->mess.ejections++;
+    node->mess.consecutivefailures = 0;
+    node->mess.outlierrequests[0] = node->mess.outlierrequests[1] = 0;
+    node->mess.outlierfailures[0] = node->mess.outlierfailures[1] = 0;
+    ap_log_error(APLOG_MARK, APLOG_WARNING, 0, r->server,
+                 "outlier_record: node %s ejected for %d seconds (%d failed requests out of %d)", node->mess.JVMRoute,
+                 (int)apr_time_sec(ejection), failures, requests);
+}
+
+/*
+ * Find the locality of the node of the session route, the proxy locality is used when that node is gone.
+ * Return NULL for new sessions, they are balanced on all the nodes, or when there is nothing to compare with.
+ */
+static const locality_t *locality_origin(const char *route, const proxy_node_table *node_table, locality_t *locality)
+{
+    int i;
+
+    if (route == NULL || *route == '\0') {
+        return NULL;
+    }
+    for (i = 0; i < node_table->sizenode; i++) {
+        const nodeinfo_t *ou = &node_table->node_info[i];
+        if (strcmp(ou->mess.JVMRoute, route) == 0) {
+            locality->region = ou->mess.Region;
+            locality->zone = ou->mess.Zone;
+            locality->rack = ou->mess.Rack;
+            return locality;
+        }
+    }
+    return proxy_locality.region ? &proxy_locality : NULL;
+}
+
+/* Cost of reaching the node from the origin: 0 same rack, 1 same zone, 2 same region, 3 other region */
+static int locality_cost(const locality_t *origin, const nodeinfo_t *node)
+{
+    if (strcmp(origin->region, node->mess.Region) != 0) {
+        return 3;
+    }
+    if (strcmp(origin->zone, node->mess.Zone) != 0) {
+        return 2;
+    }
+    if (strcmp(origin->rack, node->mess.Rack) != 0) {
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * Compare the locality of 2 workers: > 0 if worker2 is nearer, < 0 if worker1 is nearer, 0 if they are in
+ * the same tier or if the nearer worker is loaded enough to spill over to the farther one.
+ */
+static int locality_cmp(const locality_t *origin, const proxy_worker *worker1, const nodeinfo_t *node1,
+                        const proxy_worker *worker2, const nodeinfo_t *node2)
+{
+    int cost1, cost2;
+
+    if (origin == NULL) {
+        return 0;
+    }
+    cost1 = locality_cost(origin, node1);
+    cost2 = locality_cost(origin, node2);
+    if (cost1 == cost2) {
+        return 0;
+    }
+    if (locality_spillover) {
+        /* requests in flight per lbfactor, the nearer worker must exceed the farther by spillover% per tier */
+        apr_uint64_t load1 = (worker1->s->busy + 1) * 100 / effective_lbfactor(worker1, node1);
+        apr_uint64_t load2 = (worker2->s->busy + 1) * 100 / effective_lbfactor(worker2, node2);
+        int steps = cost1 > cost2 ? cost1 - cost2 : cost2 - cost1;
+        apr_uint64_t spill = 100 + (apr_uint64_t)locality_spillover * steps;
+        if (cost1 < cost2 ? load1 * 100 > load2 * spill : load2 * 100 > load1 * spill) {
+            return 0;
+        }
+    }
+    return cost1 > cost2 ? 1 : -1;
+}
+
+/*
+ * Check if the node has reached its smax: the busy count of the worker is shared by all the children.
+ * A smax received in the CONFIG message of the node is enforced, the default (-1) is not.
+ */
+static int node_saturated(const proxy_worker *worker, const nodeinfo_t *node)
+{
+    return node->mess.smax > 0 && worker->s->busy >= (apr_size_t)node->mess.smax;
+}
+
+/* Sum the requests in flight and the lbfactors of the usable nodes of the balancer for the bounded load */
+static void bounded_load_totals(const proxy_balancer *balancer, apr_uint64_t *total, apr_uint64_t *sumlbfactor)
+{
+    int i;
+    char *ptr = balancer->workers->elts;
+    int sizew = balancer->workers->elt_size;
+
+    *total = 0;
+    *sumlbfactor = 0;
+    for (i = 0; i < balancer->workers->nelts; i++, ptr = ptr + sizew) {
+        const proxy_worker *worker = *(proxy_worker **)ptr;
+        if (!worker->s || worker->s->index == -1 || worker->s->lbfactor <= 0 || !PROXY_WORKER_IS_USABLE(worker)) {
+            continue;
+        }
+        *total += worker->s->busy;
+        *sumlbfactor += worker->s->lbfactor;
+    }
+}
+
+/*
+ * Check if one more request would put the worker above (1 + BoundedLoad%) times its share of the requests
+ * in flight (counting the new one), the share of a node is given by its lbfactor.
+ */
+static int bounded_load_exceeded(const proxy_worker *worker, apr_uint64_t total, apr_uint64_t sumlbfactor)
+{
+    if (worker->s->lbfactor <= 0 || sumlbfactor == 0) {
+        return 0;
+    }
+    return (worker->s->busy + 1) * 100 * sumlbfactor > (total + 1) * (100 + bounded_load) * worker->s->lbfactor;
+}
+
+/*
+ * Check if the node is busier than the StandbyOverflow thresholds. The utilization is the busy count
+ * (all the children) over the smax of the node or the size of the connection pool.
+ */
+static int standby_overloaded(const proxy_worker *worker, const nodeinfo_t *node)
+{
+    int max = node->mess.smax > 0 ? node->mess.smax : worker->s->hmax;
+
+    if (standby_utilization && max > 0 && worker->s->busy * 100 >= (apr_size_t)max * standby_utilization) {
+        return 1;
+    }
+    if (standby_latency && node->mess.ewma_avg >= standby_latency) {
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * Max active requests of a context on the node, 0 means no limit.
+ * In auto mode the connections of the node (smax or the worker pool size) are shared by the lbfactor.
+ */
+static int context_limit(const proxy_worker *worker, const nodeinfo_t *node)
+{
+    int max;
+
+    if (context_max_requests != CONTEXT_MAX_AUTO) {
+        return context_max_requests;
+    }
+    max = node->mess.smax > 0 ? node->mess.smax : worker->s->hmax;
+    max = max * worker->s->lbfactor / 100;
+    return max > 1 ? max : 1;
+}
+
+/* Return the string of a context id without allocation for the ids of the context table */
+static const char *context_id_string(apr_pool_t *pool, int id)
+{
+    if (id >= 0 && id < context_id_count) {
+        return context_id_strings[id];
+    }
+    return apr_itoa(pool, id);
+}
+
+/* Check that the context can accept one more request on the node */
+static int context_admit(const request_rec *r, const proxy_worker *worker, const nodeinfo_t *node, int id)
+{
+    contextinfo_t *context;
+    int limit = context_limit(worker, node);
+
+    if (limit <= 0 || context_storage->read_context(id, &context) != APR_SUCCESS) {
+        return 1;
+    }
+    if (context->nbrequests < limit) {
+        return 1;
+    }
+    ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, r->server,
+                 "context_admit: context %.*s full on node %s (%d active requests)", CONTEXTSZ, context->context,
+                 node->mess.JVMRoute, context->nbrequests);
+    /* Remember the context for the queue statistics */
+    if (apr_table_get(r->notes, "context-full") == NULL) {
+        apr_table_setn(r->notes, "context-full", apr_itoa(r->pool, id));
+    }
+    return 0;
+}
+
+static proxy_worker *internal_process_worker(proxy_worker *worker, int checking_standby, int checked_domain,
+                                             const char *domain, const node_context *best,
+                                             const node_context **mynodecontext, const request_rec *r,
+                                             proxy_worker **mycandidate, nodeinfo_t **node1, const char *balancer_name,
+                                             const locality_t *origin, apr_uint32_t tie_break)
+{
+    nodeinfo_t *node;
+    const node_context *best1;
+    proxy_cluster_helper *helper = (proxy_cluster_helper *)worker->context;
+
+    if (!worker->s || !worker->context) {
+        ap_log_error(APLOG_MARK, APLOG_ERR, 0, r->server,
+                     "find_session_route: byrequests balancer %s skipping BAD worker %s", balancer_name,
+#ifdef PROXY_WORKER_EXT_NAME_SIZE
+                     worker->s ? worker->s->name_ex : "NULL");
+#else
+                     worker->s ? worker->s->name : "NULL");
+#endif
+        return NULL;
+    }
+    if (worker->s->index == -1) {
+        ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, r->server,
+                     "find_session_route: byrequests balancer skipping REMOVED worker");
+        return NULL; /* marked removed */
+    }
+    if (helper->index != worker->s->index) {
+        /* something is very bad */
+        ap_log_error(
+            APLOG_MARK, APLOG_ERR, 0, r->server,
+            "find_session_route: byrequests balancer skipping BAD worker (helper->index: %d, worker->s->index: %d)",
+            helper->index, worker->s->index);
+        return NULL; /* probably used by different worker */
+    }
+
+    ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, r->server,
+                 "find_session_route: worker %d name: %s lbfactor: %d checking_standby: %d", worker->s->index,
+#ifdef PROXY_WORKER_EXT_NAME_SIZE
+                 worker->s->name_ex, worker->s->lbfactor, checking_standby);
+#else
+                 worker->s->name, worker->s->lbfactor, checking_standby);
+#endif
+
+    /* standby logic
+     * lbfactor: -1 broken node.
+     *            0 standby.
+     *           >0 factor to use.
+     */
+    if (worker->s->lbfactor < 0 || (worker->s->lbfactor == 0 && !checking_standby)) {
+        return NULL;
+    }
+
+    /* If the worker is in error state the STATUS logic will retry it */
+    if (!PROXY_WORKER_IS_USABLE(worker)) {
+        circuit_open(worker);
+        return NULL;
+    }
+
+    /* Take into calculation only the workers that are
+     * not in error state or not disabled.
+     * and that can map the context.
+     */
+    if (best == NULL) {
+        apr_table_setn(r->subprocess_env, "BALANCER_CONTEXT_ID", "");
+        ap_log_error(APLOG_MARK, APLOG_ERR, 0, r->server, "find_session_route: byrequests balancer FAILED");
+        return NULL;
+    }
+    best1 = best;
+
+    while (best1->node != -1) {
+        if (best1->node == worker->s->index) {
+            break;
+        }
+        best1++;
+    }
+    if (best1->node == -1) {
+        return NULL; /* not found */
+    }
+
+    /* Let's do the table read only now after we know the worker is usable and matches */
+    if (read_node_worker(worker->s->index, &node, worker) != APR_SUCCESS) {
+        return NULL; /* Can't read node */
+    }
+    if (worker->s != (proxy_worker_shared *)((char *)node + NODEOFFSET)) {
+        return NULL; /* wrong shared memory address */
+    }
+
+    /* First try only nodes in the domain */
+    if (!checked_domain && !isnode_domain_ok(r, node, domain)) {
+        return NULL;
+    }
+
+    /* Skip the nodes with a half-open circuit that don't accept more trial requests */
+    if (!circuit_check(node)) {
+        return NULL;
+    }
+
+    /* Skip the nodes ejected by the outlier detection */
+    if (outlier_detection && node->mess.ejecteduntil > apr_time_now()) {
+        ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, r->server, "find_session_route: skipping ejected node %s",
+                     node->mess.JVMRoute);
+        return NULL;
+    }
+
+    /* Skip the nodes that have as many requests in flight as their smax */
+    if (node_saturated(worker, node)) {
+        ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, r->server, "find_session_route: skipping saturated node %s",
+                     node->mess.JVMRoute);
+        return NULL;
+    }
+
+    /* Skip the nodes where the context has reached its limit of active requests */
+    if (context_max_requests && !context_admit(r, worker, node, best1->context)) {
+        return NULL;
+    }
+
+    if (worker->s->lbfactor == 0 && checking_standby) {
+        *mycandidate = worker;
+        *mynodecontext = best1;
+        return worker; /* Done */
+    }
+
+    if (!(*mycandidate)) {
+        *mycandidate = worker;
+        *mynodecontext = best1;
+        *node1 = node;
+        return worker;
+    }
+
+    /* Let's avoid repeat reads of mycandidate through our loop iterations */
+    if (!(*node1) && node_storage->read_node((*mycandidate)->s->index, node1) != APR_SUCCESS) {
+        *mycandidate = NULL;
+        return worker;
+    }
+
+    if ((*mycandidate)->s->lbfactor > 0 && worker->s->lbfactor) {
+        /* The nearest nodes first, then the least loaded */
+        int cmp = locality_cmp(origin, *mycandidate, *node1, worker, node);
+        if (cmp == 0) {
+            cmp = worker_load_cmp(*mycandidate, *node1, worker, node);
+            if (cmp == 0 && random_tie_break) {
+                cmp = tie_break_cmp(*mycandidate, worker, tie_break);
+            }
+        }
+        if (cmp > 0) {
+            *mycandidate = worker;
+            *mynodecontext = best1;
+        }
+    } else {
+        ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, r->server,
+                     "find_session_route: Could not recalculate lbstatus (candidate lbfactor: %d, worker lbfactor %d)",
+                     (*mycandidate)->s->lbfactor, worker->s->lbfactor);
+    }
+
+    return worker;
+}
+
+/*
+ * The ModClusterService from the cluster fills the lbfactor values.
+ * Our logic is a bit different the mod_balancer one. We check the
+ * context and host to prevent to route to application beeing redeploy or
+ * stopped in one node but not in others.
+ * We also try the domain.
+ */
+static proxy_worker *internal_find_best_byrequests(const proxy_balancer *balancer, const proxy_server_conf *conf,
+                                                   request_rec *r, const char *domain, int failoverdomain,
+                                                   const proxy_vhost_table *vhost_table,
+                                                   const proxy_context_table *context_table,
+                                                   proxy_node_table *node_table)
+{
+    int i;
+    proxy_worker *mycandidate = NULL;
+    const node_context *mynodecontext = NULL;
+    node_context *best = NULL;
+    int checking_standby = 0;
+    int checked_standby = 0;
+    int checked_domain = 1;
+    const char *route;
+    const char *session_id = NULL;
+    apr_size_t session_id_len = 0;
+    int has_contexts = 0;
+    locality_t locality;
+    const locality_t *origin;
+    int bounded = bounded_load > 0; /* per pass */
+    apr_uint64_t total = 0;
+    apr_uint64_t sumlbfactor = 0;
+    apr_uint32_t tie_break = 0;
+
+    ap_log_error(APLOG_MARK, APLOG_TRACE4, 0, r->server,
+                 "internal_find_best_byrequests: Entering byrequests for CLUSTER (%s) failoverdomain:%d",
+                 balancer->s->name, failoverdomain);
+
+    /* create workers for new nodes */
+    if (!cache_share_for) {
+        ap_assert(node_storage->lock_nodes() == APR_SUCCESS);
+        update_workers_node(conf, r->pool, r->server, 1, node_table);
+        check_workers(conf, r->server);
+        node_storage->unlock_nodes();
+    }
+
+    /* do this once now to avoid repeating find_node_context_host through loop iterations */
+    route = apr_table_get(r->notes, "session-route");
+    best = find_node_context_host(r, balancer, route, use_alias, vhost_table, context_table, node_table, &has_contexts);
+    if (best == NULL) {
+        /* No context to serve the request we can't do much */
         if (has_contexts) {
             apr_table_setn(r->notes, "no-context-error", "1");
         }
         return NULL;
     }
 
+    /* Failover to the nodes nearest to the node of the session, or to the proxy when that node is gone */
+    origin = locality_origin(route, node_table, &locality);
+
+    if (bounded) {
+        bounded_load_totals(balancer, &total, &sumlbfactor);
+    }
+
+    /* One draw per request: the order of the equally loaded nodes is the same during the passes */
+    if (random_tie_break) {
+        ap_random_insecure_bytes(&tie_break, sizeof(tie_break));
+    }
+
+    /* Determine deterministic route, if session is associated with a route, but that route wasn't used */
+    if (deterministic_failover) {
+        const char *session_id_with_route = apr_table_get(r->notes, "session-id");
+        const char *dot = session_id_with_route ? strchr(session_id_with_route, '.') : NULL;
+        if (dot != NULL && dot != session_id_with_route) {
+            session_id = session_id_with_route;
+            session_id_len = dot - session_id_with_route;
+        }
+    }
+
     /* First try to see if we have available candidate */
     if (domain && strlen(domain) > 0) {
         checked_domain = 0;
@@ -1770,34 +2604,54 @@ static proxy_worker *internal_find_best_byrequests(const proxy_balancer *balance
     while (!checked_standby) {
         char *ptr = balancer->workers->elts;
         int sizew = balancer->workers->elt_size;
+        proxy_worker *hrwcandidate = NULL;
+        unsigned int hrwscore = 0;
+        int hrwcost = 0;
         for (i = 0; i < balancer->workers->nelts; i++, ptr = ptr + sizew) {
             nodeinfo_t *node1 = NULL;
-            proxy_worker *worker =
-                internal_process_worker(*(proxy_worker **)ptr, checking_standby, checked_domain, domain, best,
-                                        &mynodecontext, r, &mycandidate, &node1, balancer->s->name);
+            proxy_worker *worker = *(proxy_worker **)ptr;
+            /* internal_process_worker() skips the workers without shared memory */
+            if (bounded && worker->s && bounded_load_exceeded(worker, total, sumlbfactor)) {
+                continue;
+            }
+            worker = internal_process_worker(worker, checking_standby, checked_domain, domain, best, &mynodecontext, r,
+                                             &mycandidate, &node1, balancer->s->name, origin, tie_break);
             if (worker == NULL && best == NULL) {
                 return NULL;
             }
             if (worker != NULL) {
-                workers[workers_length++] = worker;
+                if (session_id) {
+                    /* Deterministic selection of target route among the nearest nodes, without spillover so the
+                     * target doesn't depend on the load */
+                    unsigned int score = rendezvous_score(session_id, session_id_len, worker->s->route);
+                    nodeinfo_t *hrwnode;
+                    int cost = 0;
+                    if (origin && read_node_worker(worker->s->index, &hrwnode, worker) == APR_SUCCESS) {
+                        cost = locality_cost(origin, hrwnode);
+                    }
+                    if (hrwcandidate == NULL || cost < hrwcost || (cost == hrwcost && score > hrwscore)) {
+                        hrwcandidate = worker;
+                        hrwscore = score;
+                        hrwcost = cost;
+                    }
+                }
                 if (worker->s->lbfactor == 0 && checking_standby) {
                     break;
                 }
             }
         }
-        session_id_with_route = apr_table_get(r->notes, "session-id");
-        session_id = session_id_with_route ? apr_strtok(strdup(session_id_with_route), ".", &tokenizer) : NULL;
-        /* Determine deterministic route, if session is associated with a route, but that route wasn't used */
-        if (deterministic_failover && session_id && strchr((char *)session_id_with_route, '.') && workers_length > 0) {
-            /* Deterministic selection of target route */
-            if (workers_length > 1) {
-                qsort(workers, workers_length, sizeof(*workers), &proxy_worker_cmp);
-            }
-            /* Compute consistent int from session id */
-            for (i = 0; session_id[i] != 0; i++) {
-                hash += session_id[i];
+        if (!mycandidate && bounded) {
+            /* Only nodes above the bounded load can serve the request in this pass: run it again without the bound */
+            bounded = 0;
+            continue;
+        }
+        if (hrwcandidate) {
+            mycandidate = hrwcandidate;
+            for (mynodecontext = best; mynodecontext->node != -1; mynodecontext++) {
+                if (mynodecontext->node == mycandidate->s->index) {
+                    break;
+                }
             }
-            mycandidate = workers[hash % workers_length];
             ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, r->server,
                          "find_best_worker: Using deterministic failover target: %s", mycandidate->s->route);
         }
@@ -1811,6 +2665,53 @@ static proxy_worker *internal_find_best_byrequests(const proxy_balancer *balance
             checked_standby = checking_standby++;
         }
         checked_domain++;
+        bounded = bounded_load > 0; /* the bound is lifted for one pass only */
+    }
+
+    /* The least loaded primary node is overloaded: use a standby node if there is one that is not */
+    if (standby_overflow && mycandidate && mycandidate->s->lbfactor > 0) {
+        nodeinfo_t *node;
+        if (read_node_worker(mycandidate->s->index, &node, mycandidate) == APR_SUCCESS &&
+            standby_overloaded(mycandidate, node)) {
+            char *ptr = balancer->workers->elts;
+            int sizew = balancer->workers->elt_size;
+            proxy_worker *beststandby = NULL;
+            const node_context *beststandbycontext = NULL;
+            nodeinfo_t *beststandbynode = NULL;
+            /* The least loaded of the standby nodes that are not overloaded */
+            for (i = 0; i < balancer->workers->nelts; i++, ptr = ptr + sizew) {
+                nodeinfo_t *node1 = NULL;
+                proxy_worker *worker = *(proxy_worker **)ptr;
+                proxy_worker *standby = NULL;
+                const node_context *standbycontext = NULL;
+                if (!worker->s || worker->s->lbfactor != 0) {
+                    continue;
+                }
+                if (internal_process_worker(worker, 1, checked_domain, domain, best, &standbycontext, r, &standby,
+                                            &node1, balancer->s->name, origin, tie_break) == NULL ||
+                    standby == NULL || read_node_worker(standby->s->index, &node, standby) != APR_SUCCESS ||
+                    standby_overloaded(standby, node)) {
+                    continue;
+                }
+                if (beststandby == NULL || worker_load_cmp(beststandby, beststandbynode, standby, node) > 0) {
+                    beststandby = standby;
+                    beststandbycontext = standbycontext;
+                    beststandbynode = node;
+                }
+            }
+            if (beststandby) {
+                ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, r->server, "find_best_worker: overflow from %s to standby %s",
+                             mycandidate->s->route, beststandby->s->route);
+                mycandidate = beststandby;
+                mynodecontext = beststandbycontext;
+            }
+        }
+    }
+
+    if (mycandidate && !circuit_admit(r, mycandidate)) {
+        /* Another request took the last trial since circuit_check(): find_best_worker() selects again */
+        apr_table_setn(r->notes, "circuit-retry", "1");
+        mycandidate = NULL;
     }
 
     if (mycandidate) {
@@ -1819,7 +2720,7 @@ static proxy_worker *internal_find_best_byrequests(const proxy_balancer *balance
             apr_table_setn(r->notes, "session-domain-ok", "1");
         }
         mycandidate->s->elected++;
-        apr_table_setn(r->subprocess_env, "BALANCER_CONTEXT_ID", apr_psprintf(r->pool, "%d", mynodecontext->context));
+        apr_table_setn(r->subprocess_env, "BALANCER_CONTEXT_ID", context_id_string(r->pool, mynodecontext->context));
         ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, r->server, "find_best_worker: byrequests balancer DONE (%s)",
 #ifdef PROXY_WORKER_EXT_NAME_SIZE
                      mycandidate->s->name_ex);
@@ -1833,12 +2734,40 @@ static proxy_worker *internal_find_best_byrequests(const proxy_balancer *balance
     return mycandidate;
 }
 
+/*
+ * Smooth a change of the load factor of a usable node: EWMA with the previous value and at most
+ * load_max_delta per STATUS. The broken and standby states are applied at once.
+ */
+static int smooth_worker_load(const proxy_worker *worker, int load)
+{
+    int old = worker->s->lbfactor;
+    int smoothed;
+
+    if (load <= 0 || old <= 0 || (worker->s->status & (PROXY_WORKER_NOT_USABLE_BITMAP | PROXY_WORKER_HOT_STANDBY))) {
+        return load;
+    }
+    smoothed = old + ((load - old) * load_smoothing_weight) / 100;
+    if (smoothed == old && load != old) {
+        smoothed += load > old ? 1 : -1; /* always move towards the reported load */
+    }
+    if (load_max_delta && smoothed > old + load_max_delta) {
+        smoothed = old + load_max_delta;
+    } else if (load_max_delta && smoothed < old - load_max_delta) {
+        smoothed = old - load_max_delta;
+    }
+    return smoothed < 1 ? 1 : smoothed;
+}
+
 static void set_worker_load(proxy_worker *worker, int load)
 {
     if (worker == NULL || load < -1 || load > 100) {
         return;
     }
 
+    if (load_smoothing) {
+        load = smooth_worker_load(worker, load);
+    }
+
     if (load == -1) {
         worker->s->status |= PROXY_WORKER_IN_ERROR;
     } else if (load == 0) {
@@ -1924,9 +2853,17 @@ static int proxy_node_isup(request_rec *r, int id, int load)
             }
 
             ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, r->server, "proxy_cluster_isup: health check says OK");
+        } else if (status_ping_interval && status_probe_cached(worker, conf, node, id)) {
+            /* Answer from the last ping/pong */
+            if (!node->mess.probeok) {
+                worker->s->status |= PROXY_WORKER_IN_ERROR;
+                ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, r->server, "proxy_cluster_isup: last pingpong failed");
+                return HTTP_INTERNAL_SERVER_ERROR;
+            }
         } else {
             char sport[7];
             char *url;
+            apr_status_t rv;
             apr_snprintf(sport, sizeof(sport), "%d", worker->s->port);
             if (strchr(worker->s->hostname, ':') != NULL) {
                 url = apr_pstrcat(r->pool, worker->s->scheme, "://[", worker->s->hostname, "]:", sport, "/", NULL);
@@ -1934,7 +2871,14 @@ static int proxy_node_isup(request_rec *r, int id, int load)
                 url = apr_pstrcat(r->pool, worker->s->scheme, "://", worker->s->hostname, ":", sport, "/", NULL);
             }
             worker->s->error_time = 0; /* Force retry now */
-            if (proxy_cluster_try_pingpong(r, worker, url, conf) != APR_SUCCESS) {
+            rv = proxy_cluster_try_pingpong(r, worker, url, conf);
+            if (status_ping_interval) {
+                ap_assert(node_storage->lock_nodes() == APR_SUCCESS);
+                node->mess.probetime = apr_time_now();
+                node->mess.probeok = rv == APR_SUCCESS;
+                node_storage->unlock_nodes();
+            }
+            if (rv != APR_SUCCESS) {
                 worker->s->status |= PROXY_WORKER_IN_ERROR;
                 ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, r->server, "proxy_cluster_isup: pingpong %s failed", url);
                 return HTTP_INTERNAL_SERVER_ERROR;
@@ -2291,10 +3235,10 @@ static void remove_removed_node(apr_pool_t *pool, const proxy_server_conf *conf,
             /* remove the node from the shared memory */
             ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, server, "remove_removed_node: %d %s %s %d", ou->mess.id,
                          ou->mess.JVMRoute, ou->mess.Port, getpid());
-            node_storage->remove_host_context(ou->mess.id, pool);
-
             strcpy(ou->mess.JVMRoute, "REMOVED");
             ou->mess.Domain[0] = '\0';
+            /* last, mod_manager then knows the tables it displays have changed */
+            node_storage->remove_host_context(ou->mess.id, pool);
 
             /* prevent real remove until processes don't have the node in workers */
             ou->updatetime = now;
@@ -2328,6 +3272,20 @@ static void remove_workers_nodes(proxy_server_conf *conf, apr_pool_t *pool, serv
     }
 }
 
+/*
+ * Wake up the requests waiting for a worker (if any), they will check if they can get one.
+ */
+static void waitqueue_wakeup(void)
+{
+#if APR_HAS_THREADS
+    if (waitqueue_cond != NULL && apr_atomic_read32(&waitqueue_length) > 0) {
+        apr_thread_mutex_lock(waitqueue_mutex);
+        apr_thread_cond_broadcast(waitqueue_cond);
+        apr_thread_mutex_unlock(waitqueue_mutex);
+    }
+#endif
+}
+
 /* Called by mc_watchdog_callback every n seconds */
 /* it is called for the main server, we need to loop on all servers */
 static void proxy_cluster_watchdog_func(server_rec *s, apr_pool_t *pool)
@@ -2419,6 +3377,8 @@ static void proxy_cluster_watchdog_func(server_rec *s, apr_pool_t *pool)
     if (last) {
         node_storage->worker_nodes_are_updated(smain, last);
     }
+    /* The status of the nodes might have changed */
+    waitqueue_wakeup();
 }
 
 
@@ -2484,7 +3444,22 @@ static void proxy_cluster_child_init(apr_pool_t *p, server_rec *s)
     proxy_server_conf *conf = (proxy_server_conf *)ap_get_module_config(sconf, &proxy_module);
     main_server = s;
 
-    (void)p; /* unused argument */
+#if APR_HAS_THREADS
+    if (apr_thread_mutex_create(&waitqueue_mutex, APR_THREAD_MUTEX_DEFAULT, p) != APR_SUCCESS ||
+        apr_thread_cond_create(&waitqueue_cond, p) != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_ERR, 0, s, "proxy_cluster_child_init: can't create the wait queue");
+        waitqueue_mutex = NULL;
+        waitqueue_cond = NULL;
+    }
+#endif
+    if (context_storage) {
+        int i;
+        context_id_count = context_storage->get_max_size_context();
+        context_id_strings = apr_palloc(p, sizeof(char *) * context_id_count);
+        for (i = 0; i < context_id_count; i++) {
+            context_id_strings[i] = apr_itoa(p, i);
+        }
+    }
     ap_assert(node_storage->lock_nodes() == APR_SUCCESS);
     if (conf && node_storage && node_storage->get_max_size_node()) {
         /* fill the cache and create pool */
@@ -2930,7 +3905,7 @@ static proxy_worker *find_route_worker(request_rec *r, const proxy_balancer *bal
                     if ((nodecontext = context_host_ok(r, balancer, index, use_alias, vhost_table, context_table,
                                                        node_table)) != NULL) {
                         apr_table_setn(r->subprocess_env, "BALANCER_CONTEXT_ID",
-                                       apr_psprintf(r->pool, "%d", nodecontext->context));
+                                       context_id_string(r->pool, nodecontext->context));
                         return worker;
                     }
 
@@ -2943,6 +3918,7 @@ static proxy_worker *find_route_worker(request_rec *r, const proxy_balancer *bal
                  * The worker might still be unusable, but we try
                  * anyway.
                  */
+                circuit_open(worker);
                 ap_proxy_retry_worker_fn("BALANCER", worker, r->server);
                 if (PROXY_WORKER_IS_USABLE(worker)) {
                     /* The context may not be available */
@@ -2953,7 +3929,7 @@ static proxy_worker *find_route_worker(request_rec *r, const proxy_balancer *bal
                     if ((nodecontext = context_host_ok(r, balancer, index, use_alias, vhost_table, context_table,
                                                        node_table)) != NULL) {
                         apr_table_setn(r->subprocess_env, "BALANCER_CONTEXT_ID",
-                                       apr_psprintf(r->pool, "%d", nodecontext->context));
+                                       context_id_string(r->pool, nodecontext->context));
                         return worker;
                     }
 
@@ -2991,7 +3967,7 @@ static proxy_worker *find_route_worker(request_rec *r, const proxy_balancer *bal
                         if ((nodecontext = context_host_ok(r, balancer, index, use_alias, vhost_table, context_table,
                                                            node_table)) != NULL) {
                             apr_table_setn(r->subprocess_env, "BALANCER_CONTEXT_ID",
-                                           apr_psprintf(r->pool, "%d", nodecontext->context));
+                                           context_id_string(r->pool, nodecontext->context));
                             return rworker;
                         }
 
@@ -3032,31 +4008,236 @@ static proxy_worker *find_session_route(const proxy_balancer *balancer, request_
     if (*route && (**route)) {
         ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, r->server, "find_session_route: Using route %s", *route);
     } else {
-        ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, r->server, "find_session_route: No route found");
-        return NULL;
+        ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, r->server, "find_session_route: No route found");
+        return NULL;
+    }
+
+    *sticky_used = apr_table_get(r->notes, "session-sticky");
+
+    if (domain) {
+        *domain = apr_table_get(r->notes, "CLUSTER_DOMAIN");
+    }
+
+    /* We have a route in path or in cookie
+     * Find the worker that has this route defined.
+     */
+    worker = find_route_worker(r, balancer, *route, vhost_table, context_table, node_table);
+    if (worker) {
+        nodeinfo_t *node;
+        if (read_node_worker(worker->s->index, &node, worker) == APR_SUCCESS && node_saturated(worker, node)) {
+            /* Spill over: find_best_worker() tries the nodes of the domain first */
+            ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, r->server, "find_session_route: node %s is saturated",
+                         node->mess.JVMRoute);
+            worker = NULL;
+        }
+    }
+    if (worker && bounded_load && bounded_load_redirect) {
+        apr_uint64_t total, sumlbfactor;
+        bounded_load_totals(balancer, &total, &sumlbfactor);
+        if (bounded_load_exceeded(worker, total, sumlbfactor)) {
+            /* Break the affinity, remove_session_route() is used for the balancers with StickySessionRemove */
+            ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, r->server, "find_session_route: node %s is above the bounded load",
+                         worker->s->route);
+            worker = NULL;
+        }
+    }
+    if (worker && !circuit_admit(r, worker)) {
+        /* The node is recovering and has enough trial requests */
+        worker = NULL;
+    }
+    if (worker && strcmp(*route, worker->s->route)) {
+        /*
+         * Notice that the route of the worker chosen is different from
+         * the route supplied by the client. (mod_proxy compatibility).
+         */
+        apr_table_setn(r->subprocess_env, "BALANCER_ROUTE_CHANGED", "1");
+        ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, r->server, "find_session_route: CLUSTER: Route changed from %s to %s",
+                     *route, worker->s->route);
+    }
+    return worker;
+}
+
+/*
+ * Find the worker used by the previous request of the client connection if it can still serve the request.
+ */
+static proxy_worker *find_connection_worker(const proxy_balancer *balancer, request_rec *r,
+                                            const proxy_vhost_table *vhost_table,
+                                            const proxy_context_table *context_table,
+                                            const proxy_node_table *node_table)
+{
+    proxy_worker *worker;
+    nodeinfo_t *node;
+    const char *context_id;
+    const proxy_cluster_conn *conn = ap_get_module_config(r->connection->conn_config, &proxy_cluster_module);
+
+    if (conn == NULL || strcmp(conn->balancer, balancer->s->name) != 0) {
+        return NULL;
+    }
+    worker = find_route_worker(r, balancer, conn->route, vhost_table, context_table, node_table);
+    if (worker == NULL || strcmp(worker->s->route, conn->route) != 0) {
+        return NULL; /* not usable, no context or redirected */
+    }
+    /* The same checks as internal_process_worker(): the standby and broken nodes get no new requests */
+    if (worker->s->lbfactor <= 0 || PROXY_WORKER_IS_STANDBY(worker)) {
+        return NULL;
+    }
+    if (read_node_worker(worker->s->index, &node, worker) != APR_SUCCESS || !circuit_check(node) ||
+        node_saturated(worker, node) || (outlier_detection && node->mess.ejecteduntil > apr_time_now())) {
+        return NULL;
+    }
+    /* find_route_worker() has set the context of the node */
+    context_id = apr_table_get(r->subprocess_env, "BALANCER_CONTEXT_ID");
+    if (context_max_requests && context_id && *context_id && !context_admit(r, worker, node, atoi(context_id))) {
+        return NULL;
+    }
+    if (bounded_load) {
+        apr_uint64_t total, sumlbfactor;
+        bounded_load_totals(balancer, &total, &sumlbfactor);
+        if (bounded_load_exceeded(worker, total, sumlbfactor)) {
+            return NULL;
+        }
+    }
+    if (!circuit_admit(r, worker)) {
+        return NULL;
+    }
+    ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, r->server, "find_connection_worker: reusing %s", conn->route);
+    return worker;
+}
+
+/* Remember the worker for the next requests of the client connection */
+static void set_connection_worker(const proxy_balancer *balancer, const proxy_worker *worker, conn_rec *c)
+{
+    proxy_cluster_conn *conn = ap_get_module_config(c->conn_config, &proxy_cluster_module);
+
+    if (conn == NULL) {
+        conn = apr_palloc(c->pool, sizeof(proxy_cluster_conn));
+        ap_set_module_config(c->conn_config, &proxy_cluster_module, conn);
+    }
+    apr_cpystrn(conn->balancer, balancer->s->name, sizeof(conn->balancer));
+    apr_cpystrn(conn->route, worker->s->route, sizeof(conn->route));
+}
+
+static proxy_worker *find_best_worker(const proxy_balancer *balancer, const proxy_server_conf *conf, request_rec *r,
+                                      const char *domain, int failoverdomain, const proxy_vhost_table *vhost_table,
+                                      const proxy_context_table *context_table, proxy_node_table *node_table,
+                                      int recurse);
+
+#if APR_HAS_THREADS
+/*
+ * Update the queue statistics of a context that was full, the waited time is only counted
+ * when the request leaves the queue (val < 0).
+ */
+static void upd_context_queue(const char *id, int val, apr_interval_time_t waited)
+{
+    contextinfo_t *context;
+
+    ap_assert(node_storage->lock_nodes() == APR_SUCCESS);
+    if (context_storage->read_context(atoi(id), &context) == APR_SUCCESS) {
+        if (val > 0 || context->nbqueued > 0) {
+            context->nbqueued += val;
+        }
+        if (val < 0 && waited > 0) {
+            context->nbwaited++;
+            context->waittime += waited;
+        }
+    }
+    node_storage->unlock_nodes();
+}
+
+/*
+ * Check that no request waiting longer than entry is waiting for the same balancer and context (FIFO),
+ * a request waiting for a full context doesn't hold back the requests for the other contexts.
+ */
+static int waitqueue_is_next(const waitqueue_entry_t *entry)
+{
+    const waitqueue_entry_t *ptr;
+    for (ptr = waitqueue_first; ptr != entry; ptr = ptr->next) {
+        if (ptr->balancer == entry->balancer && ptr->context == entry->context) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Wait in the queue until a worker is available or the balancer timeout is reached.
+ * Only the request that is next in the queue for the balancer and context retries the selection. The releases
+ * of workers in other children are not signaled, so the next request also retries every timeout/100.
+ * The waitqueue_mutex must be locked by the caller.
+ */
+static proxy_worker *waitqueue_wait(const proxy_balancer *balancer, const proxy_server_conf *conf, request_rec *r,
+                                    const char *domain, int failoverdomain, const proxy_vhost_table *vhost_table,
+                                    const proxy_context_table *context_table, proxy_node_table *node_table)
+{
+    proxy_worker *candidate = NULL;
+    apr_interval_time_t step = balancer->s->timeout / 100;
+    apr_time_t until = apr_time_now() + balancer->s->timeout;
+    const char *context_full = apr_table_get(r->notes, "context-full");
+    waitqueue_entry_t entry;
+    waitqueue_entry_t *pos = NULL;
+
+    entry.balancer = balancer;
+    entry.context = context_full ? atoi(context_full) : -1;
+    entry.sticky = apr_table_get(r->notes, "session-route") != NULL;
+    if (entry.sticky) {
+        /* Sticky requests go before the first request of a new session */
+        pos = waitqueue_first;
+        while (pos && pos->sticky) {
+            pos = pos->next;
+        }
+    }
+    entry.next = pos;
+    entry.prev = pos ? pos->prev : waitqueue_last;
+    if (entry.prev) {
+        entry.prev->next = &entry;
+    } else {
+        waitqueue_first = &entry;
     }
+    if (entry.next) {
+        entry.next->prev = &entry;
+    } else {
+        waitqueue_last = &entry;
+    }
+    apr_atomic_inc32(&waitqueue_length);
 
-    *sticky_used = apr_table_get(r->notes, "session-sticky");
-
-    if (domain) {
-        *domain = apr_table_get(r->notes, "CLUSTER_DOMAIN");
+    for (;;) {
+        apr_interval_time_t wait = until - apr_time_now();
+        if (wait <= 0) {
+            break;
+        }
+        if (step > 0 && wait > step && waitqueue_is_next(&entry)) {
+            wait = step;
+        }
+        apr_thread_cond_timedwait(waitqueue_cond, waitqueue_mutex, wait);
+        if (!waitqueue_is_next(&entry)) {
+            continue;
+        }
+        /* Our turn: try again */
+        apr_thread_mutex_unlock(waitqueue_mutex);
+        candidate = find_best_worker(balancer, conf, r, domain, failoverdomain, vhost_table, context_table, node_table,
+                                     0);
+        apr_thread_mutex_lock(waitqueue_mutex);
+        if (candidate) {
+            break;
+        }
     }
 
-    /* We have a route in path or in cookie
-     * Find the worker that has this route defined.
-     */
-    worker = find_route_worker(r, balancer, *route, vhost_table, context_table, node_table);
-    if (worker && strcmp(*route, worker->s->route)) {
-        /*
-         * Notice that the route of the worker chosen is different from
-         * the route supplied by the client. (mod_proxy compatibility).
-         */
-        apr_table_setn(r->subprocess_env, "BALANCER_ROUTE_CHANGED", "1");
-        ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, r->server, "find_session_route: CLUSTER: Route changed from %s to %s",
-                     *route, worker->s->route);
+    if (entry.prev) {
+        entry.prev->next = entry.next;
+    } else {
+        waitqueue_first = entry.next;
     }
-    return worker;
+    if (entry.next) {
+        entry.next->prev = entry.prev;
+    } else {
+        waitqueue_last = entry.prev;
+    }
+    apr_atomic_dec32(&waitqueue_length);
+    /* Let the next request for the balancer and context try */
+    apr_thread_cond_broadcast(waitqueue_cond);
+    return candidate;
 }
+#endif
 
 static proxy_worker *find_best_worker(const proxy_balancer *balancer, const proxy_server_conf *conf, request_rec *r,
                                       const char *domain, int failoverdomain, const proxy_vhost_table *vhost_table,
@@ -3065,6 +4246,7 @@ static proxy_worker *find_best_worker(const proxy_balancer *balancer, const prox
 {
     proxy_worker *candidate = NULL;
     apr_status_t rv;
+    int retries = 0;
 
     if ((rv = PROXY_THREAD_LOCK(balancer)) != APR_SUCCESS) {
         ap_log_error(APLOG_MARK, APLOG_ERR, rv, r->server,
@@ -3072,8 +4254,12 @@ static proxy_worker *find_best_worker(const proxy_balancer *balancer, const prox
         return NULL;
     }
 
-    candidate = internal_find_best_byrequests(balancer, conf, r, domain, failoverdomain, vhost_table, context_table,
-                                              node_table);
+    apr_table_unset(r->notes, "context-full");
+    do {
+        apr_table_unset(r->notes, "circuit-retry");
+        candidate = internal_find_best_byrequests(balancer, conf, r, domain, failoverdomain, vhost_table,
+                                                  context_table, node_table);
+    } while (candidate == NULL && apr_table_get(r->notes, "circuit-retry") && ++retries < CIRCUIT_MAX_RETRIES);
 
     if ((rv = PROXY_THREAD_UNLOCK(balancer)) != APR_SUCCESS) {
         ap_log_error(APLOG_MARK, APLOG_ERR, rv, r->server,
@@ -3089,24 +4275,26 @@ static proxy_worker *find_best_worker(const proxy_balancer *balancer, const prox
          * returns SERVER_BUSY.
          */
 #if APR_HAS_THREADS
-        if (balancer->s->timeout && recurse) {
-            /* XXX: This can perhaps be build using some
-             * smarter mechanism, like tread_cond.
-             * But since the statuses can came from
-             * different childs, use the provided algo.
-             */
-            apr_interval_time_t timeout = balancer->s->timeout;
-            apr_interval_time_t step, tval = 0;
-
-            step = timeout / 100;
-            while (tval < timeout) {
-                apr_sleep(step);
-                /* Try again */
-                if ((candidate = find_best_worker(balancer, conf, r, domain, failoverdomain, vhost_table, context_table,
-                                                  node_table, 0))) {
-                    break;
-                }
-                tval += step;
+        if (balancer->s->timeout && recurse && waitqueue_mutex != NULL) {
+            const char *context_full = apr_table_get(r->notes, "context-full");
+            apr_time_t start = apr_time_now();
+            int waited = 0;
+            if (context_full) {
+                upd_context_queue(context_full, 1, 0);
+            }
+            apr_thread_mutex_lock(waitqueue_mutex);
+            if (waitqueue_max && apr_atomic_read32(&waitqueue_length) >= waitqueue_max) {
+                ap_log_error(APLOG_MARK, APLOG_ERR, 0, r->server,
+                             "find_best_worker: CLUSTER: (%s). Too many requests waiting for a worker",
+                             balancer->s->name);
+            } else {
+                candidate = waitqueue_wait(balancer, conf, r, domain, failoverdomain, vhost_table, context_table,
+                                           node_table);
+                waited = 1;
+            }
+            apr_thread_mutex_unlock(waitqueue_mutex);
+            if (context_full) {
+                upd_context_queue(context_full, -1, waited ? apr_time_now() - start : 0);
             }
         }
 #endif
@@ -3222,16 +4410,80 @@ static void upd_context_count(const char *id, int val, const server_rec *s)
     }
 }
 
+/*
+ * Retry budget: each new request adds retry_budget hundredths of a failover attempt to the budget of
+ * the child (up to RETRY_MAX_TOKENS), each failover attempt takes a whole one.
+ */
+static void retry_budget_deposit(void)
+{
+    apr_uint32_t old, new;
+
+    do {
+        old = apr_atomic_read32(&retry_tokens);
+        if (old >= RETRY_MAX_TOKENS) {
+            return;
+        }
+        new = old + retry_budget;
+        if (new > RETRY_MAX_TOKENS) {
+            new = RETRY_MAX_TOKENS;
+        }
+    } while (apr_atomic_cas32(&retry_tokens, new, old) != old);
+}
+
+static int retry_budget_withdraw(void)
+{
+    apr_uint32_t old;
+
+    do {
+        old = apr_atomic_read32(&retry_tokens);
+        if (old < 100) {
+            return 0;
+        }
+    } while (apr_atomic_cas32(&retry_tokens, old - 100, old) != old);
+    return 1;
+}
+
 static apr_status_t decrement_busy_count(void *w)
 {
     proxy_worker *worker = (proxy_worker *)w;
     if (worker->s->busy > 0) {
         worker->s->busy--;
     }
+    waitqueue_wakeup();
 
     return APR_SUCCESS;
 }
 
+/*
+ * Note the time of the first output of the response: the response time of the backend doesn't
+ * include the time needed to send the whole response to the client.
+ */
+static apr_status_t proxy_cluster_timing_filter(ap_filter_t *f, apr_bucket_brigade *bb)
+{
+    proxy_cluster_timing *timing = f->ctx;
+
+    if (timing->first == 0) {
+        timing->first = apr_time_now();
+    }
+    ap_remove_output_filter(f);
+    return ap_pass_brigade(f->next, bb);
+}
+
+/* Start measuring the response time of the worker elected for the request */
+static void start_timing(request_rec *r)
+{
+    proxy_cluster_timing *timing = ap_get_module_config(r->request_config, &proxy_cluster_module);
+
+    if (timing == NULL) {
+        timing = apr_palloc(r->pool, sizeof(proxy_cluster_timing));
+        ap_set_module_config(r->request_config, &proxy_cluster_module, timing);
+        ap_add_output_filter("PROXY_CLUSTER_TIMING", timing, r, r->connection);
+    }
+    /* A failover attempt starts again */
+    timing->start = apr_time_now();
+    timing->first = 0;
+}
+
 /*
  * Find a worker for mod_proxy logic
  */
@@ -3247,6 +4499,8 @@ static int proxy_cluster_pre_request(proxy_worker **worker, proxy_balancer **bal
     apr_status_t rv;
     proxy_cluster_helper *helper;
     const char *context_id;
+    int failover = *balancer != NULL;
+    int recurse = 1;
 
     /* the node should be filled in trans(). */
     proxy_vhost_table *vhost_table = (proxy_vhost_table *)apr_table_get(r->notes, "vhost-table");
@@ -3302,6 +4556,8 @@ static int proxy_cluster_pre_request(proxy_worker **worker, proxy_balancer **bal
                     if (helper->count_active > 0) {
                         helper->count_active--;
                     }
+                    /* mod_proxy only fails over from an unusable worker: the trial request failed */
+                    circuit_result(r, *run, 1);
                     break;
                 }
             }
@@ -3309,6 +4565,17 @@ static int proxy_cluster_pre_request(proxy_worker **worker, proxy_balancer **bal
         } else {
             ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, r->server, "proxy_cluster_pre_request: NO worker");
         }
+        apr_table_unset(r->notes, "circuit-trial");
+
+        /* This is a failover attempt: without budget left it still fails over but doesn't wait for a worker */
+        if (retry_budget && !retry_budget_withdraw()) {
+            ap_log_error(APLOG_MARK, APLOG_WARNING, 0, r->server,
+                         "proxy_cluster_pre_request: CLUSTER: (%s). Retry budget exhausted, failover without waiting",
+                         (*balancer)->s->name);
+            recurse = 0;
+        }
+    } else if (retry_budget) {
+        retry_budget_deposit();
     }
 
     /* TODO if we don't have a balancer but a route we should use it directly */
@@ -3332,6 +4599,9 @@ static int proxy_cluster_pre_request(proxy_worker **worker, proxy_balancer **bal
     /* Step 2: find the session route */
 
     runtime = find_session_route(*balancer, r, &route, &sticky, url, &domain, vhost_table, context_table, node_table);
+    if (runtime == NULL && route == NULL && connection_affinity && !failover) {
+        runtime = find_connection_worker(*balancer, r, vhost_table, context_table, node_table);
+    }
 
     /* Lock the LoadBalancer
      * XXX: perhaps we need the process lock here
@@ -3339,6 +4609,9 @@ static int proxy_cluster_pre_request(proxy_worker **worker, proxy_balancer **bal
     if ((rv = PROXY_THREAD_LOCK(*balancer)) != APR_SUCCESS) {
         ap_log_error(APLOG_MARK, APLOG_ERR, rv, r->server,
                      "proxy_cluster_pre_request: CLUSTER: (%s). Lock failed for pre_request", (*balancer)->s->name);
+        if (runtime) {
+            circuit_release(r, runtime);
+        }
         return DECLINED;
     }
     if (runtime) {
@@ -3373,8 +4646,8 @@ static int proxy_cluster_pre_request(proxy_worker **worker, proxy_balancer **bal
     }
     if (!*worker) {
         /* We have to failover (in domain only may be) or we don't use sticky sessions */
-        runtime =
-            find_best_worker(*balancer, conf, r, domain, failoverdomain, vhost_table, context_table, node_table, 1);
+        runtime = find_best_worker(*balancer, conf, r, domain, failoverdomain, vhost_table, context_table, node_table,
+                                   recurse);
         if (!runtime) {
             const char *no_context_error = apr_table_get(r->notes, "no-context-error");
             if (no_context_error == NULL) {
@@ -3414,6 +4687,11 @@ static int proxy_cluster_pre_request(proxy_worker **worker, proxy_balancer **bal
 
     (*worker)->s->busy++;
     apr_pool_cleanup_register(r->pool, *worker, decrement_busy_count, apr_pool_cleanup_null);
+    start_timing(r);
+
+    if (connection_affinity && route == NULL) {
+        set_connection_worker(*balancer, *worker, r->connection);
+    }
 
     /* Also mark the context here note that find_best_worker set BALANCER_CONTEXT_ID */
     context_id = apr_table_get(r->subprocess_env, "BALANCER_CONTEXT_ID");
@@ -3448,6 +4726,9 @@ static int proxy_cluster_pre_request(proxy_worker **worker, proxy_balancer **bal
      * real hostname of the elected worker.
      */
     access_status = rewrite_url(r, *worker, url);
+    if (access_status != OK) {
+        circuit_release(r, *worker);
+    }
 
     ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, r->server,
                  "proxy_cluster_pre_request: balancer (%s) worker (%s) rewritten to %s", (*balancer)->s->name,
@@ -3464,6 +4745,8 @@ static int proxy_cluster_post_request(proxy_worker *worker, proxy_balancer *bala
                                       proxy_server_conf *conf)
 {
     proxy_cluster_helper *helper;
+    nodeinfo_t *node;
+    const proxy_cluster_timing *timing;
     const char *sessionid;
     const char *route;
     char *cookie = NULL;
@@ -3484,8 +4767,30 @@ static int proxy_cluster_post_request(proxy_worker *worker, proxy_balancer *bala
         helper->count_active--;
     }
 
+    if (outlier_detection && read_node_worker(worker->s->index, &node, worker) == APR_SUCCESS) {
+        outlier_record(r, node, r->status >= HTTP_INTERNAL_SERVER_ERROR);
+    }
+    circuit_result(r, worker, r->status >= HTTP_INTERNAL_SERVER_ERROR);
+
     node_storage->unlock_nodes();
 
+    /*
+     * Record the response time (until the first output, without the time spent in the queue) and the errors
+     * of the node, the shared values are updated without lock.
+     */
+    timing = ap_get_module_config(r->request_config, &proxy_cluster_module);
+    if (timing && read_node_worker(worker->s->index, &node, worker) == APR_SUCCESS) {
+        apr_time_t elapsed = (timing->first ? timing->first : apr_time_now()) - timing->start;
+        if (elapsed < 0) {
+            elapsed = 0;
+        } else if (elapsed > APR_UINT32_MAX) {
+            elapsed = APR_UINT32_MAX;
+        }
+        update_ewma(&node->mess.ewma_time, &node->mess.ewma_stamp, (apr_uint32_t)elapsed, 1);
+        update_ewma(&node->mess.ewma_avg, NULL, (apr_uint32_t)elapsed, 0);
+        update_ewma(&node->mess.ewma_errors, NULL, r->status >= HTTP_INTERNAL_SERVER_ERROR ? EWMA_ERROR : 0, 0);
+    }
+
     ap_log_error(APLOG_MARK, APLOG_TRACE4, 0, r->server, "proxy_cluster_post_request: for (%s) %s", balancer->s->name,
                  balancer->s->sticky);
 
@@ -3592,6 +4897,9 @@ static void proxy_cluster_hooks(apr_pool_t *p)
     proxy_hook_pre_request(proxy_cluster_pre_request, NULL, NULL, APR_HOOK_FIRST);
     proxy_hook_post_request(proxy_cluster_post_request, NULL, NULL, APR_HOOK_FIRST);
 
+    /* response time of the backends */
+    ap_register_output_filter("PROXY_CLUSTER_TIMING", proxy_cluster_timing_filter, NULL, AP_FTYPE_RESOURCE);
+
     /* Register a provider for the "ping/pong" logic */
     ap_register_provider(p, "proxy_cluster", "balancer", "0", &balancerhandler);
     /* Register a provider for the loadbalancer (for things like ProxyPass /titi balancer://mycluster/myapp) */
@@ -3694,6 +5002,302 @@ static const char *cmd_proxy_cluster_deterministic_failover(cmd_parms *parms, vo
     return NULL;
 }
 
+static const char *cmd_proxy_cluster_balancing_mode(cmd_parms *cmd, void *dummy, const char *arg)
+{
+    (void)cmd;
+    (void)dummy;
+
+    if (strcasecmp(arg, "Requests") == 0) {
+        balancing_mode = BALANCE_BYREQUESTS;
+    } else if (strcasecmp(arg, "Outstanding") == 0) {
+        balancing_mode = BALANCE_OUTSTANDING;
+    } else if (strcasecmp(arg, "PeakEWMA") == 0) {
+        balancing_mode = BALANCE_PEAK_EWMA;
+    } else {
+        return "BalancingMode must be one of: Requests, Outstanding or PeakEWMA";
+    }
+
+    return NULL;
+}
+
+static const char *cmd_proxy_cluster_retry_budget(cmd_parms *cmd, void *dummy, const char *arg)
+{
+    int val = atoi(arg);
+    (void)cmd;
+    (void)dummy;
+
+    if (val < 0 || val > 100) {
+        return "RetryBudget must be a percentage between 0 and 100";
+    }
+
+    retry_budget = (apr_uint32_t)val;
+    return NULL;
+}
+
+static const char *cmd_proxy_cluster_circuit_breaker_trials(cmd_parms *cmd, void *dummy, const char *arg)
+{
+    int val = atoi(arg);
+    (void)cmd;
+    (void)dummy;
+
+    if (val < 0) {
+        return "CircuitBreakerTrials must be greater than 0";
+    }
+
+    circuit_trials = (apr_uint32_t)val;
+    return NULL;
+}
+
+/*
+ * Parse the arguments of a RAW_ARGS directive with key=value parameters: Off disables the feature, On
+ * enables it with the default values. The values must be integers >= 0, set() checks and stores each one.
+ */
+static const char *parse_key_values(cmd_parms *cmd, const char *arg,
+                                    const char *(*set)(cmd_parms *cmd, const char *key, int val), int *enabled)
+{
+    const char *name = cmd->cmd->name;
+
+    if (strcasecmp(arg, "Off") == 0) {
+        *enabled = 0;
+        return NULL;
+    }
+    if (strcasecmp(arg, "On") != 0) {
+        while (*arg) {
+            char *key = ap_getword_conf(cmd->pool, &arg);
+            char *val = strchr(key, '=');
+            const char *err;
+            int ival;
+            if (!val) {
+                return apr_psprintf(cmd->pool, "Invalid %s parameter. Parameter must be in the form 'key=value'",
+                                    name);
+            }
+            *val++ = '\0';
+            ival = atoi(val);
+            if (ival < 0) {
+                return apr_psprintf(cmd->pool, "%s %s must be greater than 0", name, key);
+            }
+            if ((err = set(cmd, key, ival)) != NULL) {
+                return err;
+            }
+        }
+    }
+
+    *enabled = 1;
+    return NULL;
+}
+
+static const char *set_outlier_detection(cmd_parms *cmd, const char *key, int val)
+{
+    if (strcasecmp(key, "Consecutive") == 0) {
+        outlier_consecutive = val;
+    } else if (strcasecmp(key, "Rate") == 0) {
+        if (val > 100) {
+            return "OutlierDetection Rate is a percentage";
+        }
+        outlier_rate = val;
+    } else if (strcasecmp(key, "MinRequests") == 0) {
+        outlier_min_requests = val;
+    } else if (strcasecmp(key, "Window") == 0) {
+        if (val == 0) {
+            return "OutlierDetection Window must be greater than 0";
+        }
+        outlier_window = apr_time_from_sec(val);
+    } else if (strcasecmp(key, "Ejection") == 0) {
+        if (val == 0) {
+            return "OutlierDetection Ejection must be greater than 0";
+        }
+        outlier_ejection = apr_time_from_sec(val);
+    } else if (strcasecmp(key, "MaxEjected") == 0) {
+        if (val > 100) {
+            return "OutlierDetection MaxEjected is a percentage";
+        }
+        outlier_max_ejected = val;
+    } else {
+        return apr_psprintf(cmd->pool, "Unknown OutlierDetection parameter %s", key);
+    }
+    return NULL;
+}
+
+static const char *cmd_proxy_cluster_outlier_detection(cmd_parms *cmd, void *dummy, const char *arg)
+{
+    (void)dummy;
+    return parse_key_values(cmd, arg, set_outlier_detection, &outlier_detection);
+}
+
+static const char *set_standby_overflow(cmd_parms *cmd, const char *key, int val)
+{
+    if (strcasecmp(key, "Utilization") == 0) {
+        if (val > 100) {
+            return "StandbyOverflow Utilization is a percentage";
+        }
+        standby_utilization = val;
+    } else if (strcasecmp(key, "Latency") == 0) {
+        standby_latency = apr_time_from_msec(val);
+    } else {
+        return apr_psprintf(cmd->pool, "Unknown StandbyOverflow parameter %s", key);
+    }
+    return NULL;
+}
+
+static const char *set_load_smoothing(cmd_parms *cmd, const char *key, int val)
+{
+    if (strcasecmp(key, "Weight") == 0) {
+        if (val == 0 || val > 100) {
+            return "LoadSmoothing Weight is a percentage greater than 0";
+        }
+        load_smoothing_weight = val;
+    } else if (strcasecmp(key, "MaxDelta") == 0) {
+        load_max_delta = val;
+    } else {
+        return apr_psprintf(cmd->pool, "Unknown LoadSmoothing parameter %s", key);
+    }
+    return NULL;
+}
+
+static const char *cmd_proxy_cluster_load_smoothing(cmd_parms *cmd, void *dummy, const char *arg)
+{
+    (void)dummy;
+    return parse_key_values(cmd, arg, set_load_smoothing, &load_smoothing);
+}
+
+static const char *cmd_proxy_cluster_random_tie_break(cmd_parms *parms, void *mconfig, int on)
+{
+    (void)parms;
+    (void)mconfig;
+    random_tie_break = on;
+    return NULL;
+}
+
+static const char *cmd_proxy_cluster_standby_overflow(cmd_parms *cmd, void *dummy, const char *arg)
+{
+    const char *err;
+    (void)dummy;
+
+    if ((err = parse_key_values(cmd, arg, set_standby_overflow, &standby_overflow)) != NULL) {
+        return err;
+    }
+    if (strcasecmp(arg, "On") == 0) {
+        standby_utilization = STANDBY_UTILIZATION;
+    }
+    if (standby_overflow) {
+        standby_overflow = standby_utilization || standby_latency;
+    }
+    return NULL;
+}
+
+static const char *cmd_proxy_cluster_connection_affinity(cmd_parms *parms, void *mconfig, int on)
+{
+    connection_affinity = on;
+    (void)parms;
+    (void)mconfig;
+
+    return NULL;
+}
+
+static const char *cmd_proxy_cluster_status_ping_interval(cmd_parms *cmd, void *dummy, const char *arg)
+{
+    int val = atoi(arg);
+    (void)cmd;
+    (void)dummy;
+
+    if (val < 0) {
+        return "StatusPingInterval must be greater than 0";
+    }
+    status_ping_interval = apr_time_from_sec(val);
+    return NULL;
+}
+
+static const char *cmd_proxy_cluster_bounded_load(cmd_parms *cmd, void *dummy, const char *arg, const char *redirect)
+{
+    int val;
+    (void)cmd;
+    (void)dummy;
+
+    if (strcasecmp(arg, "Off") == 0) {
+        bounded_load = 0;
+        return NULL;
+    }
+    val = atoi(arg);
+    if (val <= 0) {
+        return "BoundedLoad must be Off or greater than 0";
+    }
+    bounded_load = val;
+    if (redirect) {
+        if (strcasecmp(redirect, "Redirect") != 0) {
+            return "BoundedLoad second parameter must be Redirect";
+        }
+        bounded_load_redirect = 1;
+    } else {
+        bounded_load_redirect = 0;
+    }
+    return NULL;
+}
+
+#if APR_HAS_THREADS
+static const char *cmd_proxy_cluster_max_waiting_requests(cmd_parms *cmd, void *dummy, const char *arg)
+{
+    int val = atoi(arg);
+    (void)cmd;
+    (void)dummy;
+
+    if (val < 0) {
+        return "MaxWaitingRequests must be greater than 0";
+    }
+
+    waitqueue_max = (apr_uint32_t)val;
+    return NULL;
+}
+#endif
+
+static const char *cmd_proxy_cluster_proxy_locality(cmd_parms *cmd, void *dummy, const char *region, const char *zone,
+                                                    const char *rack)
+{
+    (void)dummy;
+
+    if (strlen(region) >= LOCALITYSZ || (zone && strlen(zone) >= LOCALITYSZ) || (rack && strlen(rack) >= LOCALITYSZ)) {
+        return apr_psprintf(cmd->pool, "ProxyLocality values must be shorter than %d", LOCALITYSZ);
+    }
+    proxy_locality.region = region;
+    proxy_locality.zone = zone ? zone : "";
+    proxy_locality.rack = rack ? rack : "";
+    return NULL;
+}
+
+static const char *cmd_proxy_cluster_locality_spillover(cmd_parms *cmd, void *dummy, const char *arg)
+{
+    int val = atoi(arg);
+    (void)cmd;
+    (void)dummy;
+
+    if (val < 0) {
+        return "LocalitySpillover must be greater than 0";
+    }
+    locality_spillover = val;
+    return NULL;
+}
+
+static const char *cmd_proxy_cluster_context_max_requests(cmd_parms *cmd, void *dummy, const char *arg)
+{
+    int val;
+    (void)cmd;
+    (void)dummy;
+
+    if (strcasecmp(arg, "Off") == 0) {
+        context_max_requests = 0;
+        return NULL;
+    }
+    if (strcasecmp(arg, "Auto") == 0) {
+        context_max_requests = CONTEXT_MAX_AUTO;
+        return NULL;
+    }
+    val = atoi(arg);
+    if (val <= 0) {
+        return "ContextMaxRequests must be Off, Auto or greater than 0";
+    }
+    context_max_requests = val;
+    return NULL;
+}
+
 static const char *cmd_proxy_cluster_cache_shared_for(cmd_parms *cmd, void *dummy, const char *arg)
 {
     int val = atoi(arg);
@@ -3803,6 +5407,10 @@ static const command_rec proxy_cluster_cmds[] = {
                      "OPTIONS (Default: On)"),
     AP_INIT_FLAG("DeterministicFailover", cmd_proxy_cluster_deterministic_failover, NULL, OR_ALL,
                  "DeterministicFailover - controls whether a node upon failover is chosen deterministically (Default: Off)"),
+    AP_INIT_TAKE1("BalancingMode", cmd_proxy_cluster_balancing_mode, NULL, OR_ALL,
+                  "BalancingMode - How the best node is chosen Requests: requests elected in the LBstatusRecalTime "
+                  "interval, Outstanding: requests in flight, PeakEWMA: response time and error rate times requests "
+                  "in flight, all weighted by the load factor (Default: Requests)"),
     AP_INIT_TAKE1("CacheShareFor", cmd_proxy_cluster_cache_shared_for, NULL, OR_ALL,
                   "CacheShareFor - Time in seconds for how long the shared information is cached by httpd: (Default: 0 "
                   "seconds, no-caching)"),
@@ -3818,6 +5426,54 @@ static const command_rec proxy_cluster_cmds[] = {
         OR_ALL,
         "ResponseStatusCodeOnNoContext - Response code returned when ProxyPass or ProxyMatch doesn't have matching context (Default: 404)"
     ),
+    AP_INIT_TAKE1("RetryBudget", cmd_proxy_cluster_retry_budget, NULL, OR_ALL,
+                  "RetryBudget - Failover attempts that may wait for a worker in percentage of the requests, the other "
+                  "ones fail over only to a worker available at once (Default: 0 no budget)"),
+    AP_INIT_TAKE1("CircuitBreakerTrials", cmd_proxy_cluster_circuit_breaker_trials, NULL, OR_ALL,
+                  "CircuitBreakerTrials - Number of trial requests (of all the children) a node gets when it is usable "
+                  "again after an error, all of them must succeed before it gets full traffic (Default: 0 no circuit "
+                  "breaker)"),
+    AP_INIT_RAW_ARGS("OutlierDetection", cmd_proxy_cluster_outlier_detection, NULL, OR_ALL,
+                     "OutlierDetection - Eject for a while the nodes failing (5xx) too many requests: Off, On or "
+                     "key=value with Consecutive (Default: 5), Rate percentage (Default: 0), MinRequests for the rate "
+                     "(Default: 10), Window seconds (Default: 10), Ejection seconds doubled on each ejection (Default: "
+                     "30), MaxEjected percentage of nodes (Default: 50) (Default: Off)"),
+    AP_INIT_TAKE123("ProxyLocality", cmd_proxy_cluster_proxy_locality, NULL, OR_ALL,
+                    "ProxyLocality - Region [Zone [Rack]] of the proxy, the sessions of a removed node fail over to "
+                    "the nearest nodes (the nodes send their Region, Zone and Rack in CONFIG) (Default: none)"),
+    AP_INIT_TAKE1("LocalitySpillover", cmd_proxy_cluster_locality_spillover, NULL, OR_ALL,
+                  "LocalitySpillover - Percentage of extra load per locality tier before using a farther node "
+                  "(Default: 0 the nearest usable nodes are always used)"),
+    AP_INIT_RAW_ARGS("LoadSmoothing", cmd_proxy_cluster_load_smoothing, NULL, OR_ALL,
+                     "LoadSmoothing - Smooth the load factors sent by the nodes in STATUS: Off, On or key=value with "
+                     "Weight percentage of the new value in the average (Default: 50) and MaxDelta change of the load "
+                     "factor per STATUS (Default: 0 no limit) (Default: Off)"),
+    AP_INIT_FLAG("RandomTieBreak", cmd_proxy_cluster_random_tie_break, NULL, OR_ALL,
+                 "RandomTieBreak - Choose in a random order drawn for each request between nodes with the same load "
+                 "(Default: Off)"),
+    AP_INIT_RAW_ARGS("StandbyOverflow", cmd_proxy_cluster_standby_overflow, NULL, OR_ALL,
+                     "StandbyOverflow - Use the standby nodes (lbfactor 0) when the least loaded node is overloaded: "
+                     "Off, On (Utilization=80) or key=value with Utilization percentage of busy/smax and Latency "
+                     "milliseconds of the average response time (Default: Off)"),
+    AP_INIT_TAKE1("StatusPingInterval", cmd_proxy_cluster_status_ping_interval, NULL, OR_ALL,
+                  "StatusPingInterval - STATUS messages use the last ping/pong of the node when it is younger than "
+                  "that (in seconds), it is refreshed in the background after half of it (Default: 0 ping for each "
+                  "STATUS)"),
+    AP_INIT_FLAG("ConnectionAffinity", cmd_proxy_cluster_connection_affinity, NULL, OR_ALL,
+                 "ConnectionAffinity - Send the requests without session of a client connection to the worker of the "
+                 "previous request while it can serve them (Default: Off)"),
+    AP_INIT_TAKE12("BoundedLoad", cmd_proxy_cluster_bounded_load, NULL, OR_ALL,
+                   "BoundedLoad - Percentage above its share of the requests in flight a node can get new sessions, "
+                   "with Redirect the sticky requests of the nodes above it also go to other nodes (Default: Off)"),
+    AP_INIT_TAKE1("ContextMaxRequests", cmd_proxy_cluster_context_max_requests, NULL, OR_ALL,
+                  "ContextMaxRequests - Maximum number of active requests of a context on a node, Auto derives it "
+                  "from the node smax and lbfactor, the excess requests wait if the balancer has a timeout "
+                  "(Default: Off)"),
+#if APR_HAS_THREADS
+    AP_INIT_TAKE1("MaxWaitingRequests", cmd_proxy_cluster_max_waiting_requests, NULL, OR_ALL,
+                  "MaxWaitingRequests - Maximum number of requests of a child waiting for a worker when the balancer "
+                  "has a timeout (Default: 0 no limit)"),
+#endif
 #if MC_USE_THREADS
     AP_INIT_TAKE1("ModProxyClusterThreadCount", cmd_mc_thread_count, NULL, OR_ALL,
                   "ModProxyClusterThreadCount - Set custom size for the watchdog thread pool (Default: 16)"),
@@ -6,6 +6,9 @@ require Exporter;
 use HTTP::Request;
 use HTTP::Request::Common ();
 use LWP::UserAgent;
+use IO::Socket::INET;
+use POSIX ();
+use Apache::Test ();
 use Apache::TestRequest 'GET';
 
 our @ISA = qw(Exporter);
@@ -19,6 +22,17 @@ our @EXPORT = qw(
   parse_response
   remove_nodes
   remove_all_nodes
+  restart_with
+  check_directive
+  add_node
+  add_app_node
+  add_dead_node
+  set_app
+  served_by
+  GET_background
+  free_port
+  start_fake_node
+  stop_fake_node
 );
 
 our $VERSION = '0.0.1';
@@ -190,7 +204,7 @@ sub parse_DUMP {
 
 sub CMD {
 	my ($cmd, $params, $path) = @_;
-	my @mpc_commands = qw(CONFIG ENABLE-APP DISABLE-APP STOP-APP REMOVE-APP STOP-APP-RSP
+	my @mpc_commands = qw(CONFIG ENABLE-APP DISABLE-APP STOP-APP REMOVE-APP BATCH-APP STOP-APP-RSP
 				STATUS STATUS-RSP INFO INFO-RSP DUMP DUMP-RSP PING PING-RSP VERSION);
     $path = '' if not defined $path;
     $params = {} if not defined $params;
@@ -235,5 +249,147 @@ sub remove_all_nodes {
     remove_nodes (map { $_->{JVMRoute} } @{$resp->{Nodes}});
 }
 
+# Restart the server with the directives added to its main configuration (t/conf/mpc_test.conf),
+# without directives the server goes back to the default test configuration.
+# The restart also clears the nodes, contexts and hosts.
+sub restart_with {
+	my @directives = @_;
+	my $cfg = Apache::Test::config();
+	my $file = "$cfg->{vars}{t_conf}/mpc_test.conf";
+
+	if (@directives) {
+		open(my $fh, '>', $file) or die "Can't write $file: $!";
+		print $fh map { "$_\n" } @directives;
+		close $fh;
+	} else {
+		unlink $file;
+	}
+	$cfg->server->stop();
+	$cfg->server->start();
+}
+
+# Returns 1 if httpd accepts the directive on top of the test configuration (httpd -t)
+sub check_directive {
+	my $directive = shift;
+	my $vars = Apache::Test::config()->{vars};
+
+	my $pid = fork;
+	die "Can't fork: $!" unless defined $pid;
+	if ($pid == 0) {
+		open STDOUT, '>', '/dev/null';
+		open STDERR, '>', '/dev/null';
+		exec $vars->{httpd}, '-t', '-d', $vars->{serverroot}, '-f', $vars->{t_conf_file}, '-c', $directive;
+		POSIX::_exit(255);
+	}
+	waitpid $pid, 0;
+	return $? == 0 ? 1 : 0;
+}
+
+# Register the node with the /news context and make it usable with a STATUS (Load 100 by default),
+# the parameters are added to the CONFIG message. Returns 1 if all the messages succeeded.
+sub add_node {
+	my ($route, $host, $port, $load, %params) = @_;
+	$load = 100 if not defined $load;
+
+	my $resp = CMD 'CONFIG', { JVMRoute => $route, Type => 'http', Host => $host, Port => $port, %params };
+	return 0 if not $resp->is_success;
+	$resp = CMD 'ENABLE-APP', { JVMRoute => $route, Context => '/news', Alias => 'localhost' };
+	return 0 if not $resp->is_success;
+	$resp = CMD 'STATUS', { JVMRoute => $route, Load => $load };
+	return $resp->is_success && $resp->content =~ /State=OK/ ? 1 : 0;
+}
+
+# add_node for one of the fake apps of t/conf/cgi.conf.in (fake_cgi_app or fake_cgi_app2)
+sub add_app_node {
+	my ($route, $app, $load, %params) = @_;
+
+	Apache::TestRequest::module($app);
+	my ($host, $port) = split ':', Apache::TestRequest::hostport();
+	Apache::TestRequest::module('mpc_test_host');
+
+	return add_node $route, $host, $port, $load, %params;
+}
+
+# add_node for a node that is down: the STATUS sees it up, the requests get connection refused
+sub add_dead_node {
+	my ($route, %params) = @_;
+	my $port = free_port();
+
+	my $pid = start_fake_node($port);
+	my $ok = add_node $route, '127.0.0.1', $port, 100, %params;
+	stop_fake_node($pid);
+
+	return $ok;
+}
+
+# Make a fake app slow (delay => seconds) or failing with 500 (fail => 1), undef removes it
+sub set_app {
+	my ($app, $control, $value) = @_;
+	my $file = Apache::Test::vars('documentroot') . "/$control-$app";
+
+	if (not defined $value) {
+		unlink $file;
+		return;
+	}
+	open(my $fh, '>', $file) or die "Can't write $file: $!";
+	print $fh $value;
+	close $fh;
+}
+
+# Name of the fake app that answered the request
+sub served_by {
+	my $resp = shift;
+	my ($app) = $resp->content =~ /^QUERY_STRING --> .*\bapp=([^&\s]+)/m;
+	return defined $app ? $app : '';
+}
+
+# Send a GET to the mpc_test_host from a child process, for the requests that must be in flight
+# while the test goes on. Returns the pid to wait for.
+sub GET_background {
+	my ($path, @headers) = @_;
+
+	my $pid = fork;
+	die "Can't fork: $!" unless defined $pid;
+	return $pid if $pid;
+	LWP::UserAgent->new()->get($ROOT . $path, @headers);
+	POSIX::_exit(0);
+}
+
+# A local port nobody listens on
+sub free_port {
+	my $sock = IO::Socket::INET->new(LocalAddr => '127.0.0.1', LocalPort => 0, Listen => 1) or die "Can't bind: $!";
+	my $port = $sock->sockport;
+	close $sock;
+	return $port;
+}
+
+# Answer 200 to any HTTP request on the port (the ping of the STATUS messages) until stop_fake_node
+sub start_fake_node {
+	my $port = shift;
+	my $server = IO::Socket::INET->new(LocalAddr => '127.0.0.1', LocalPort => $port, Listen => 5, ReuseAddr => 1)
+		or die "Can't listen on $port: $!";
+
+	my $pid = fork;
+	die "Can't fork: $!" unless defined $pid;
+	if ($pid) {
+		close $server;
+		return $pid;
+	}
+	while (my $client = $server->accept()) {
+		while (my $line = <$client>) {
+			last if $line =~ /^\r?\n$/;
+		}
+		print $client "HTTP/1.1 200 OK\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+		close $client;
+	}
+	POSIX::_exit(0);
+}
+
+sub stop_fake_node {
+	my $pid = shift;
+	kill 'TERM', $pid;
+	waitpid $pid, 0;
+}
+
 1;
 
@@ -1,4 +1,13 @@
 #!/usr/bin/perl
+# The tests make an app slow or failing with the delay-<app> (seconds) and fail-<app> files of the document root
+my ($app) = ($ENV{QUERY_STRING} // '') =~ /(?:^|&)app=([^&]*)/;
+if ($app && open(my $delay, '<', "$ENV{DOCUMENT_ROOT}/delay-$app")) {
+    select(undef, undef, undef, <$delay> + 0);
+    close $delay;
+}
+if ($app && -e "$ENV{DOCUMENT_ROOT}/fail-$app") {
+    print "Status: 500 Internal Server Error\n";
+}
 print "Content-Type: text/plain\n\n";
 
 print "Fake App!\n";
@@ -18,7 +18,7 @@ Apache::TestRequest::module("fake_cgi_app");
 my ($apphost, $appport) = split ':', Apache::TestRequest::hostport();
 Apache::TestRequest::module("mpc_test_host");
 
-plan tests => 366, need_mpc;
+plan tests => 374, need_mpc;
 
 
 foreach my $cmd ('ENABLE-APP', 'STOP-APP', 'DISABLE-APP', 'REMOVE-APP') {
@@ -393,6 +393,29 @@ foreach my $present_context (@contexts) {
     ok t_cmp($rsp->is_success, 1, "$present_context is reachable: " . $rsp->code);
 }
 
+# ########################################################## #
+# Several commands in one BATCH-APP message, applied at once #
+# ########################################################## #
+$resp = CMD 'REMOVE-APP', { JVMRoute => "fake-app" }, "/*";
+ok $resp->is_success;
+
+$resp = CMD 'CONFIG', { JVMRoute => "fake-app", Type => "http", Host => $apphost, Port => $appport };
+ok $resp->is_success;
+
+$resp = CMD_internal 'BATCH-APP', '/', 'JVMRoute=fake-app&Context=/news&Alias=localhost&Command=ENABLE-APP';
+ok t_cmp($resp->is_error, 1, "BATCH-APP with Context before Command should fail");
+
+$resp = CMD_internal 'BATCH-APP', '/', 'JVMRoute=fake-app&Command=ENABLE-APP&Context=/news&Alias=localhost&Command=STOP-APP&Context=/first&Alias=localhost';
+ok t_cmp($resp->is_success, 1, "BATCH-APP with two commands should be ok");
+ok t_cmp($resp->content, qr/ENABLE-APP-RSP/);
+ok t_cmp($resp->content, qr/STOP-APP-RSP/);
+
+$resp = CMD 'INFO';
+%p = parse_response 'INFO', $resp->content;
+my %status = map { $_->{Context} => $_->{Status} } @{$p{Contexts}};
+ok t_cmp($status{'/news'}, 'ENABLED', "/news got enabled by BATCH-APP");
+ok t_cmp($status{'/first'}, 'STOPPED', "/first got stopped by BATCH-APP");
+
 # Clean after yourself by a simple restart of the server
 END {
     my $ret = $?;
@@ -0,0 +1,54 @@
+# Before 'make install' is performed this script should be runnable with
+# 'make test'. After 'make install' it should work as 'perl Apache-ModProxyCluster.t'
+#########################
+
+use strict;
+use warnings;
+
+use Apache::Test;
+use Apache::TestUtil;
+use Apache::TestConfig;
+use Apache::TestRequest 'GET';
+
+use HTTP::Request;
+use LWP::UserAgent;
+
+use ModProxyCluster;
+
+Apache::TestRequest::module("mpc_test_host");
+
+plan tests => 7, need_mpc;
+
+# Send the message in chunks (chunked transfer encoding): the fields, the values and the
+# %-encoded characters are cut in the middle
+sub CMD_chunked {
+    my ($cmd, @chunks) = @_;
+    my $request = HTTP::Request->new($cmd, "$ModProxyCluster::ROOT/", [], sub { shift @chunks });
+
+    return LWP::UserAgent->new()->request($request);
+}
+
+my $resp = CMD_chunked 'CONFIG', 'JVMRo', 'ute=chunked&Ty', 'pe=http&Host=127.0.0.1&Po', 'rt=8080&sm', 'ax=7&Balancer=chu',
+                                 'nked&Alias=local', 'host&Context=%2', 'Fne', 'ws%2', 'C%2Fsp', 'lit';
+ok $resp->is_success;
+
+my %p = parse_response 'INFO', (CMD 'INFO')->content;
+my ($node) = grep { $_->{Name} eq 'chunked' } @{$p{Nodes}};
+ok t_cmp($node->{Name}, 'chunked', "The node is registered");
+ok t_cmp($node->{Balancer}, 'chunked', "The balancer is set");
+ok t_cmp($node->{Smax}, 7, "The smax is set");
+my @contexts = sort grep { m{^/(news|split)$} } map { $_->{Context} } @{$p{Contexts}};
+ok t_cmp("@contexts", '/news /split', "The contexts are decoded");
+
+# A forbidden character is detected in a %-encoded sequence cut in the middle
+$resp = CMD_chunked 'CONFIG', 'JVMRoute=bad%3', 'Cname&Type=http';
+ok $resp->is_error;
+%p = parse_response 'INFO', (CMD 'INFO')->content;
+ok t_cmp(scalar(grep { $_->{Name} =~ /^bad/ } @{$p{Nodes}}), 0, "The node with a forbidden character is rejected");
+
+# Clean after yourself by a simple restart of the server
+END {
+    my $ret = $?;
+    restart_with();
+    $? = $ret;
+}
@@ -0,0 +1,51 @@
+# Before 'make install' is performed this script should be runnable with
+# 'make test'. After 'make install' it should work as 'perl Apache-ModProxyCluster.t'
+#########################
+
+use strict;
+use warnings;
+
+use Apache::Test;
+use Apache::TestUtil;
+use Apache::TestConfig;
+use Apache::TestRequest 'GET';
+
+use ModProxyCluster;
+
+Apache::TestRequest::module("mpc_test_host");
+
+plan tests => 6, need_mpc;
+
+###################################################################
+### UpdateCoalesceTime: the workers follow a registration storm ###
+###################################################################
+restart_with 'UpdateCoalesceTime 500';
+
+# The MCMP messages are still applied at once
+my $registered = grep {
+    (CMD 'CONFIG', { JVMRoute => "storm$_", Type => 'http', Host => '127.0.0.1', Port => free_port() })->is_success
+} 1..15;
+ok t_cmp($registered, 15, "The nodes of the storm are registered");
+ok add_app_node 'app1', 'fake_cgi_app';
+
+my %p = parse_response 'INFO', (CMD 'INFO')->content;
+ok t_cmp(scalar(@{$p{Nodes}}), 16, "INFO shows all the nodes");
+
+# The children update their workers once the nodes are quiet
+sleep 1;
+my $resp = GET '/news';
+ok t_cmp(served_by($resp), 'fake_cgi_app', "The request goes to the node registered in the storm");
+
+# The removals reach the workers too
+$resp = CMD 'REMOVE-APP', { JVMRoute => 'app1' }, '/*';
+ok $resp->is_success;
+sleep 1;
+$resp = GET '/news';
+ok $resp->is_error;
+
+# Clean after yourself: restart without the directives of the test
+END {
+    my $ret = $?;
+    restart_with();
+    $? = $ret;
+}
@@ -18,7 +18,7 @@ my ($apphost, $appport) = split ':', Apache::TestRequest::hostport();
 Apache::TestRequest::module("mpc_test_host");
 
 
-plan tests => 310, need_mpc;
+plan tests => 317, need_mpc;
 
 
 # CONFIG wihtout JVMRoute should fail
@@ -113,6 +113,20 @@ ok t_cmp(@{$p{Nodes}}, 2, "There are two nodes now");
 ok t_cmp(@{$p{Contexts}}, 1, "There is the /news context");
 ok t_cmp(@{$p{Hosts}}, 1, "There is the myalias alias");
 
+# The node has a context its CONFIG without Alias doesn't list: the CONFIG is applied (ETag of DUMP, the
+# generation of the tables) but it keeps the context
+my $etag = (CMD 'DUMP')->header('ETag');
+$resp = CMD 'CONFIG', { JVMRoute => "fake-app", Type => "http", Host => $apphost, Port => $appport };
+ok $resp->is_success;
+ok t_cmp((CMD 'DUMP')->header('ETag') ne $etag, 1, "A CONFIG without Alias is applied to a node with contexts");
+
+$resp = GET "/news";
+ok t_cmp($resp->is_success, 1, "The /news context is still available after the same CONFIG");
+
+$resp = CMD 'INFO';
+%p = parse_response 'INFO', $resp->content;
+ok t_cmp($p{Contexts}->[0]{Status}, "ENABLED", "The /news context is still enabled");
+
 # i)
 foreach my $param (@node_config) {
     $resp = CMD 'CONFIG', { JVMRoute => "fake-app", Type => "http", Host => $apphost,
@@ -169,6 +183,17 @@ ok t_cmp(@{$p{Nodes}}, 2, "There are two nodes now");
 ok t_cmp(@{$p{Hosts}}, 3, "There should be 3 aliases");
 ok t_cmp(@{$p{Contexts}}, 9, "There should be 9 contexts (3 per each of the 3 aliases)");
 
+# The same CONFIG with the Alias and Context again changes nothing either
+$etag = (CMD 'DUMP')->header('ETag');
+$resp = CMD 'CONFIG', { JVMRoute => "fake-app", Type => "http", Host => $apphost, Port => $appport
+                      , Context => "/first,/news,/last", Alias => "news.example.com,myhost,example.com" };
+ok $resp->is_success;
+ok t_cmp((CMD 'DUMP')->header('ETag'), $etag, "The tables are not modified by the same CONFIG with Alias and Context");
+
+$resp = CMD 'INFO';
+%p = parse_response 'INFO', $resp->content;
+ok t_cmp(@{$p{Contexts}}, 9, "There are still 9 contexts");
+
 # The following should fail, because all contexts are STOPPED by default
 $resp = GET "/news";
 ok t_cmp($resp->is_error, 1, "The app should NOT be available again for /news");
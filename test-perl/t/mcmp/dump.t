@@ -9,6 +9,8 @@ use Apache::Test;
 use Apache::TestUtil;
 use Apache::TestConfig;
 use Apache::TestRequest 'GET';
+use HTTP::Request;
+use LWP::UserAgent;
 
 use ModProxyCluster;
 
@@ -16,7 +18,7 @@ Apache::TestRequest::module("fake_cgi_app");
 my ($apphost, $appport) = split ':', Apache::TestRequest::hostport();
 Apache::TestRequest::module("mpc_test_host");
 
-plan tests => 47, need_mpc;
+plan tests => 49, need_mpc;
 
 
 # DUMP with no nodes 
@@ -47,6 +49,12 @@ ok t_cmp(@{$p{Hosts}},     0, "No hosts in DUMP output for empty cluster");
 
 ok t_cmp($p{Nodes}->[0]{JVMRoute}, "fake-app");
 
+# Nothing changed, DUMP with the ETag of the last response gives 304
+my $etag = $resp->header('ETag');
+ok defined $etag;
+$resp = LWP::UserAgent->new()->request(HTTP::Request->new('DUMP', $ModProxyCluster::ROOT, ['If-None-Match' => $etag]));
+ok t_cmp($resp->code, 304, "DUMP is not modified");
+
 # Add Context + Alias
 $resp = CMD 'ENABLE-APP', { JVMRoute => "fake-app", Context => "/context", Alias => "myalias" };
 ok $resp->is_success;
@@ -9,6 +9,8 @@ use Apache::Test;
 use Apache::TestUtil;
 use Apache::TestConfig;
 use Apache::TestRequest 'GET';
+use HTTP::Request;
+use LWP::UserAgent;
 
 use ModProxyCluster;
 
@@ -17,7 +19,7 @@ Apache::TestRequest::module("fake_cgi_app");
 my ($apphost, $appport) = split ':', Apache::TestRequest::hostport();
 Apache::TestRequest::module("mpc_test_host");
 
-plan tests => 40, need_mpc;
+plan tests => 43, need_mpc;
 
 
 my $resp = CMD 'INFO';
@@ -65,6 +67,14 @@ ok t_cmp($p{Nodes}->[0]{Name}, "fake-app");
 ok t_cmp($p{Contexts}->[0]{Context}, "/context");
 ok t_cmp($p{Hosts}->[0]{Alias}, "myalias");
 
+# The ETag of INFO is weak and doesn't depend on the traffic counters
+my $etag = $resp->header('ETag');
+ok t_cmp($etag, qr/^W\/"/, "The ETag of INFO is weak");
+$resp = LWP::UserAgent->new()->request(HTTP::Request->new('INFO', $ModProxyCluster::ROOT, ['If-None-Match' => $etag]));
+ok t_cmp($resp->code, 304, "INFO is not modified");
+$resp = CMD 'INFO';
+ok $resp->is_success;
+
 # Check again Context's and Alias' properties
 my @alias_info = qw( Vhost Alias );
 foreach my $opt (@alias_info) {
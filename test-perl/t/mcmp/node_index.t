@@ -0,0 +1,75 @@
+# Before 'make install' is performed this script should be runnable with
+# 'make test'. After 'make install' it should work as 'perl Apache-ModProxyCluster.t'
+#########################
+
+use strict;
+use warnings;
+
+use Apache::Test;
+use Apache::TestUtil;
+use Apache::TestConfig;
+use Apache::TestRequest 'GET';
+
+use ModProxyCluster;
+
+Apache::TestRequest::module("mpc_test_host");
+
+plan tests => 15, need_mpc;
+
+# Start with empty tables
+restart_with();
+
+# The contexts with their status and the aliases in the INFO response
+sub contexts {
+    my %p = parse_response 'INFO', (CMD 'INFO')->content;
+    return join ' ', sort map { "$_->{Context}:$_->{Status}" } @{$p{Contexts}};
+}
+
+sub aliases {
+    my %p = parse_response 'INFO', (CMD 'INFO')->content;
+    return join ' ', sort map { $_->{Alias} } @{$p{Hosts}};
+}
+
+# The section of the node in the manager page
+sub manager_node {
+    my $node = shift;
+    my ($section) = (GET '/mod_cluster_manager')->content =~ m{(<h1> Node $node .*?)(?:<h1> Node |\z)}s;
+    return $section // '';
+}
+
+my $resp = CMD 'CONFIG', { JVMRoute => 'a', Type => 'http', Host => '127.0.0.1', Port => free_port() };
+ok $resp->is_success;
+$resp = CMD 'CONFIG', { JVMRoute => 'b', Type => 'http', Host => '127.0.0.1', Port => free_port() };
+ok $resp->is_success;
+$resp = CMD 'ENABLE-APP', { JVMRoute => 'a', Context => '/a1,/a2,/a3', Alias => 'a.example' };
+ok $resp->is_success;
+$resp = CMD 'ENABLE-APP', { JVMRoute => 'b', Context => '/b1,/b2', Alias => 'b.example' };
+ok $resp->is_success;
+
+ok t_cmp(contexts(), '/a1:ENABLED /a2:ENABLED /a3:ENABLED /b1:ENABLED /b2:ENABLED', "Each node has its contexts");
+ok t_cmp(aliases(), 'a.example b.example', "Each node has its alias");
+
+# The manager page lists the contexts under their node
+ok t_cmp(manager_node('a'), qr{^(?!.*/b1).*/a1, Status: ENABLED}s, "The contexts of a are in its section");
+ok t_cmp(manager_node('b'), qr{^(?!.*/a1).*/b1, Status: ENABLED}s, "The contexts of b are in its section");
+
+# The commands of a node only change its own contexts
+$resp = CMD 'DISABLE-APP', { JVMRoute => 'a' }, '/*';
+ok $resp->is_success;
+ok t_cmp(contexts(), '/a1:DISABLED /a2:DISABLED /a3:DISABLED /b1:ENABLED /b2:ENABLED', "Only the contexts of a are disabled");
+
+$resp = CMD 'REMOVE-APP', { JVMRoute => 'a' }, '/*';
+ok $resp->is_success;
+ok t_cmp(contexts(), '/b1:ENABLED /b2:ENABLED', "The contexts of a are removed");
+ok t_cmp(aliases(), 'b.example', "The alias of a is removed");
+
+$resp = CMD 'STOP-APP', { JVMRoute => 'b' }, '/*';
+ok $resp->is_success;
+ok t_cmp(contexts(), '/b1:STOPPED /b2:STOPPED', "The contexts of b are stopped");
+
+# Clean after yourself by a simple restart of the server
+END {
+    my $ret = $?;
+    restart_with();
+    $? = $ret;
+}
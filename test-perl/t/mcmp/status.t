@@ -17,7 +17,7 @@ Apache::TestRequest::module("fake_cgi_app");
 my ($apphost, $appport) = split ':', Apache::TestRequest::hostport();
 Apache::TestRequest::module("mpc_test_host");
 
-plan tests => 30, need_mpc;
+plan tests => 35, need_mpc;
 
 
 my $resp = CMD 'CONFIG', { JVMRoute => "host" };
@@ -105,6 +105,18 @@ ok $resp->is_success;
 # TODO: Nodes should be probably addressable by their route
 ok t_cmp($p{Nodes}->[0]{Load}, 50, "Load remains, Load=-2 was ignored for node $p{Nodes}->[0]{Name}");
 
+# The metrics reduce the Load: 50 with half of the Cpu used gives 25
+$resp = CMD 'STATUS', { JVMRoute => "fake-app", Load => 50, Cpu => 50 };
+ok $resp->is_success;
+$resp = CMD 'INFO';
+ok $resp->is_success;
+%p = parse_response 'INFO', $resp->content;
+ok t_cmp($p{Nodes}->[0]{Load}, 25, "Load should be 25 with Cpu=50 for node $p{Nodes}->[0]{Name}");
+
+$resp = CMD 'STATUS', { JVMRoute => "fake-app", Load => 50, Heap => 101 };
+ok $resp->is_error;
+ok t_cmp($resp->header("Mess"), "SYNTAX: Heap field has bad value", "Heap=101 is rejected");
+
 
 # Clean after yourself by a simple restart of the server
 END {
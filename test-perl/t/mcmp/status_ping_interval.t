@@ -0,0 +1,78 @@
+# Before 'make install' is performed this script should be runnable with
+# 'make test'. After 'make install' it should work as 'perl Apache-ModProxyCluster.t'
+#########################
+
+use strict;
+use warnings;
+
+use Apache::Test;
+use Apache::TestUtil;
+use Apache::TestConfig;
+use Apache::TestRequest 'GET';
+
+use ModProxyCluster;
+
+Apache::TestRequest::module("mpc_test_host");
+
+plan tests => 9, need_mpc;
+
+my $port = free_port();
+my ($resp, $pid);
+
+##########################################################
+### StatusPingInterval: STATUS uses the last ping/pong ###
+##########################################################
+restart_with 'StatusPingInterval 30';
+
+$resp = CMD 'CONFIG', { JVMRoute => 'cached', Type => 'http', Host => '127.0.0.1', Port => $port };
+ok $resp->is_success;
+
+# Nobody listens on the port, the ping fails
+$resp = CMD 'STATUS', { JVMRoute => 'cached', Load => 100 };
+ok t_cmp($resp->content, qr/State=NOTOK/, "The ping of the node fails");
+
+# The node is up now, but the failed ping is younger than 30 seconds
+$pid = start_fake_node($port);
+$resp = CMD 'STATUS', { JVMRoute => 'cached', Load => 100 };
+ok t_cmp($resp->content, qr/State=NOTOK/, "STATUS answers with the last ping");
+stop_fake_node($pid);
+
+############################################################
+### An expired result is not used, STATUS pings the node ###
+############################################################
+restart_with 'StatusPingInterval 2';
+
+$resp = CMD 'CONFIG', { JVMRoute => 'cached', Type => 'http', Host => '127.0.0.1', Port => $port };
+ok $resp->is_success;
+
+$resp = CMD 'STATUS', { JVMRoute => 'cached', Load => 100 };
+ok t_cmp($resp->content, qr/State=NOTOK/, "The ping of the node fails");
+
+$pid = start_fake_node($port);
+sleep 3;
+$resp = CMD 'STATUS', { JVMRoute => 'cached', Load => 100 };
+ok t_cmp($resp->content, qr/State=OK/, "STATUS pings the node once the last ping is too old");
+stop_fake_node($pid);
+
+#############################################
+### Without it each STATUS pings the node ###
+#############################################
+restart_with();
+
+$resp = CMD 'CONFIG', { JVMRoute => 'cached', Type => 'http', Host => '127.0.0.1', Port => $port };
+ok $resp->is_success;
+
+$resp = CMD 'STATUS', { JVMRoute => 'cached', Load => 100 };
+ok t_cmp($resp->content, qr/State=NOTOK/, "The ping of the node fails");
+
+$pid = start_fake_node($port);
+$resp = CMD 'STATUS', { JVMRoute => 'cached', Load => 100 };
+ok t_cmp($resp->content, qr/State=OK/, "STATUS pings the node again");
+stop_fake_node($pid);
+
+# Clean after yourself: restart without the directives of the test
+END {
+    my $ret = $?;
+    restart_with();
+    $? = $ret;
+}
@@ -0,0 +1,92 @@
+# Before 'make install' is performed this script should be runnable with
+# 'make test'. After 'make install' it should work as 'perl Apache-ModProxyCluster.t'
+#########################
+
+use strict;
+use warnings;
+
+use Apache::Test;
+use Apache::TestUtil;
+use Apache::TestConfig;
+use Apache::TestRequest 'GET';
+
+use LWP::UserAgent;
+
+use ModProxyCluster;
+
+Apache::TestRequest::module("mpc_test_host");
+
+plan tests => 15, need_mpc;
+
+my (@apps, %seen, $pid);
+
+############################################################
+### DeterministicFailover: the session id picks the node ###
+############################################################
+restart_with 'DeterministicFailover On';
+
+ok add_app_node 'app1', 'fake_cgi_app', 100, StickySessionForce => 'No';
+ok add_app_node 'app2', 'fake_cgi_app2', 100, StickySessionForce => 'No';
+ok add_dead_node 'gone', StickySessionForce => 'No';
+
+# The first request finds out that the node of the sessions is down
+GET '/news', Cookie => 'JSESSIONID=first.gone';
+
+foreach my $session (qw(first second)) {
+    @apps = map { served_by(GET '/news', Cookie => "JSESSIONID=$session.gone") } 1..6;
+    %seen = map { $_ => 1 } @apps;
+    ok t_cmp(join(',', sort keys %seen), qr/^fake_cgi_app2?$/, "The requests of the $session session fail over to one node");
+}
+
+####################################################
+### Smax: a saturated node gets no more requests ###
+####################################################
+restart_with();
+
+ok add_app_node 'app1', 'fake_cgi_app', 100, StickySessionForce => 'No', Smax => 1;
+ok add_app_node 'app2', 'fake_cgi_app2', 100, StickySessionForce => 'No';
+
+set_app 'fake_cgi_app', 'delay', 3;
+$pid = GET_background '/news', Cookie => 'JSESSIONID=smax.app1';
+sleep 1;
+ok t_cmp(served_by(GET '/news', Cookie => 'JSESSIONID=smax.app1'), 'fake_cgi_app2', "The session spills over to app2");
+ok t_cmp(served_by(GET '/news'), 'fake_cgi_app2', "A new request goes to app2");
+waitpid $pid, 0;
+set_app 'fake_cgi_app', 'delay';
+
+####################################################
+### BoundedLoad Redirect: the affinity is broken ###
+####################################################
+restart_with 'BoundedLoad 50 Redirect';
+
+ok add_app_node 'app1', 'fake_cgi_app', 100, StickySessionForce => 'No';
+ok add_app_node 'app2', 'fake_cgi_app2', 100, StickySessionForce => 'No';
+
+# With one request in flight app1 has all the load, a second one would put it above 150% of its share
+set_app 'fake_cgi_app', 'delay', 3;
+$pid = GET_background '/news', Cookie => 'JSESSIONID=bounded.app1';
+sleep 1;
+ok t_cmp(served_by(GET '/news', Cookie => 'JSESSIONID=bounded.app1'), 'fake_cgi_app2', "The session goes to app2");
+waitpid $pid, 0;
+set_app 'fake_cgi_app', 'delay';
+
+#########################################################
+### ConnectionAffinity: a connection sticks to a node ###
+#########################################################
+restart_with 'ConnectionAffinity On', 'KeepAlive On';
+
+ok add_app_node 'app1', 'fake_cgi_app';
+ok add_app_node 'app2', 'fake_cgi_app2';
+
+my $ua = LWP::UserAgent->new(keep_alive => 1);
+@apps = map { served_by($ua->get("$ModProxyCluster::ROOT/news")) } 1..6;
+%seen = map { $_ => 1 } @apps;
+ok t_cmp(scalar(keys %seen), 1, "The requests of the connection go to the same node (@apps)");
+
+# Clean after yourself: restart without the directives of the test
+END {
+    my $ret = $?;
+    set_app 'fake_cgi_app', 'delay';
+    restart_with();
+    $? = $ret;
+}
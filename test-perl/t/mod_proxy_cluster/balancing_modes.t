@@ -0,0 +1,104 @@
+# Before 'make install' is performed this script should be runnable with
+# 'make test'. After 'make install' it should work as 'perl Apache-ModProxyCluster.t'
+#########################
+
+use strict;
+use warnings;
+
+use Apache::Test;
+use Apache::TestUtil;
+use Apache::TestConfig;
+use Apache::TestRequest 'GET';
+
+use ModProxyCluster;
+
+Apache::TestRequest::module("mpc_test_host");
+
+plan tests => 20, need_mpc;
+
+my (%count, @apps, $pid, $resp, %p);
+
+#################################################
+### Outstanding: the requests in flight count ###
+#################################################
+restart_with 'BalancingMode Outstanding';
+
+ok add_app_node 'app1', 'fake_cgi_app';
+ok add_app_node 'app2', 'fake_cgi_app2';
+
+# A slow sticky request keeps app2 busy, the new requests go to app1
+set_app 'fake_cgi_app2', 'delay', 3;
+$pid = GET_background '/news', Cookie => 'JSESSIONID=outstanding.app2';
+sleep 1;
+@apps = map { served_by GET '/news' } 1..4;
+ok t_cmp("@apps", join(' ', ('fake_cgi_app') x 4), "The node with a request in flight gets no new request");
+waitpid $pid, 0;
+set_app 'fake_cgi_app2', 'delay';
+
+##########################################
+### PeakEWMA: the slow node is avoided ###
+##########################################
+restart_with 'BalancingMode PeakEWMA';
+
+ok add_app_node 'app1', 'fake_cgi_app';
+ok add_app_node 'app2', 'fake_cgi_app2';
+
+set_app 'fake_cgi_app2', 'delay', 1;
+%count = ();
+$count{served_by(GET '/news')}++ for 1..10;
+ok t_cmp($count{fake_cgi_app} // 0, qr/^(8|9|10)$/, "The fast node gets the requests");
+ok t_cmp($count{fake_cgi_app2} // 0, qr/^[0-2]$/, "The slow node gets at most its first samples");
+set_app 'fake_cgi_app2', 'delay';
+
+###############################################
+### Requests with RandomTieBreak: both used ###
+###############################################
+restart_with 'RandomTieBreak On';
+
+ok add_app_node 'app1', 'fake_cgi_app';
+ok add_app_node 'app2', 'fake_cgi_app2';
+
+%count = ();
+$count{served_by(GET '/news')}++ for 1..6;
+ok t_cmp($count{fake_cgi_app} // 0, qr/^[2-4]$/, "app1 gets its share of the requests");
+ok t_cmp($count{fake_cgi_app2} // 0, qr/^[2-4]$/, "app2 gets its share of the requests");
+
+####################################################
+### LoadSmoothing: the STATUS loads are averaged ###
+####################################################
+restart_with 'LoadSmoothing Weight=50 MaxDelta=20';
+
+# The first load is taken as it is
+ok add_app_node 'app1', 'fake_cgi_app';
+
+# 100 -> 50: the average (75) is limited by MaxDelta
+$resp = CMD 'STATUS', { JVMRoute => 'app1', Load => 50 };
+ok $resp->is_success;
+%p = parse_response 'INFO', (CMD 'INFO')->content;
+ok t_cmp($p{Nodes}->[0]{Load}, 80, "Load 50 after 100 gives 80");
+
+# 80 -> 50: the average is 65
+$resp = CMD 'STATUS', { JVMRoute => 'app1', Load => 50 };
+ok $resp->is_success;
+%p = parse_response 'INFO', (CMD 'INFO')->content;
+ok t_cmp($p{Nodes}->[0]{Load}, 65, "Load 50 after 80 gives 65");
+
+# A broken node is not smoothed
+$resp = CMD 'STATUS', { JVMRoute => 'app1', Load => -1 };
+ok $resp->is_success;
+%p = parse_response 'INFO', (CMD 'INFO')->content;
+ok t_cmp($p{Nodes}->[0]{Load}, -1, "Load -1 is applied at once");
+
+# Recovering is not smoothed either
+$resp = CMD 'STATUS', { JVMRoute => 'app1', Load => 100 };
+ok $resp->is_success;
+%p = parse_response 'INFO', (CMD 'INFO')->content;
+ok t_cmp($p{Nodes}->[0]{Load}, 100, "Load 100 after -1 is applied at once");
+
+# Clean after yourself: restart without the directives of the test
+END {
+    my $ret = $?;
+    set_app 'fake_cgi_app2', 'delay';
+    restart_with();
+    $? = $ret;
+}
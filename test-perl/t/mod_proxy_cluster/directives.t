@@ -0,0 +1,93 @@
+# Before 'make install' is performed this script should be runnable with
+# 'make test'. After 'make install' it should work as 'perl Apache-ModProxyCluster.t'
+#########################
+
+use strict;
+use warnings;
+
+use Apache::Test;
+use Apache::TestUtil;
+use Apache::TestConfig;
+use Apache::TestRequest 'GET';
+
+use ModProxyCluster;
+
+Apache::TestRequest::module("mpc_test_host");
+
+# Each directive is checked with httpd -t on top of the test configuration
+my @valid = (
+    'BalancingMode Requests',
+    'BalancingMode Outstanding',
+    'BalancingMode PeakEWMA',
+    'DeterministicFailover On',
+    'RetryBudget 0',
+    'RetryBudget 20',
+    'CircuitBreakerTrials 0',
+    'CircuitBreakerTrials 3',
+    'OutlierDetection Off',
+    'OutlierDetection On',
+    'OutlierDetection Consecutive=3 Rate=50 MinRequests=20 Window=5 Ejection=10 MaxEjected=30',
+    'ProxyLocality eu',
+    'ProxyLocality eu west rack1',
+    'LocalitySpillover 50',
+    'LoadSmoothing Off',
+    'LoadSmoothing On',
+    'LoadSmoothing Weight=30 MaxDelta=10',
+    'RandomTieBreak On',
+    'StandbyOverflow Off',
+    'StandbyOverflow On',
+    'StandbyOverflow Utilization=90 Latency=500',
+    'StatusPingInterval 10',
+    'ConnectionAffinity On',
+    'BoundedLoad Off',
+    'BoundedLoad 25',
+    'BoundedLoad 25 Redirect',
+    'ContextMaxRequests Off',
+    'ContextMaxRequests Auto',
+    'ContextMaxRequests 10',
+    'MaxWaitingRequests 10',
+    'SlowStart 30',
+    'UpdateCoalesceTime 100',
+    'LoadMetricWeight Cpu 50',
+    'LoadMetricWeight Threads 0',
+);
+
+my @invalid = (
+    'BalancingMode Random',
+    'RetryBudget -1',
+    'RetryBudget 101',
+    'CircuitBreakerTrials -1',
+    'OutlierDetection Rate=101',
+    'OutlierDetection MaxEjected=101',
+    'OutlierDetection Window=0',
+    'OutlierDetection Ejection=0',
+    'OutlierDetection Ejected=10',
+    'OutlierDetection Consecutive',
+    'OutlierDetection Consecutive=-1',
+    'ProxyLocality averyveryverylongregion',
+    'LocalitySpillover -1',
+    'LoadSmoothing Weight=0',
+    'LoadSmoothing Weight=101',
+    'LoadSmoothing Delta=10',
+    'StandbyOverflow Utilization=101',
+    'StandbyOverflow Latency',
+    'StatusPingInterval -1',
+    'BoundedLoad 0',
+    'BoundedLoad 25 Always',
+    'ContextMaxRequests 0',
+    'MaxWaitingRequests -1',
+    'SlowStart -1',
+    'UpdateCoalesceTime -1',
+    'LoadMetricWeight Disk 50',
+    'LoadMetricWeight Heap -1',
+);
+
+plan tests => @valid + @invalid, need_mpc;
+
+foreach my $directive (@valid) {
+    ok t_cmp(check_directive($directive), 1, "'$directive' is accepted");
+}
+
+foreach my $directive (@invalid) {
+    ok t_cmp(check_directive($directive), 0, "'$directive' is rejected");
+}
@@ -13,7 +13,7 @@ use Apache::TestRequest 'GET';
 use ModProxyCluster;
 Apache::TestRequest::module("mpc_test_host");
 
-plan tests => 69, need_mpc;
+plan tests => 81, need_mpc;
 
 my $hostport = Apache::TestRequest::hostport();
 
@@ -177,6 +177,31 @@ $resp = GET "/mod_cluster_manager";
 ok $resp->is_success;
 ok (index($resp->as_string, "Node spare") == -1);
 
+## SlowStart
+$resp = CMD 'CONFIG', { JVMRoute => 'spare', SlowStart => -10 };
+
+ok $resp->is_error;
+ok ($resp->content ne "");
+ok ($resp->header("Type") eq "SYNTAX");
+ok ($resp->header("Mess") eq "SYNTAX: SlowStart field has bad value");
+
+$resp = GET "/mod_cluster_manager";
+ok $resp->is_success;
+ok (index($resp->as_string, "Node spare") == -1);
+
+## Zone
+my $long_zone = "z" x 20;
+$resp = CMD 'CONFIG', { JVMRoute => 'spare', Zone => $long_zone };
+
+ok $resp->is_error;
+ok ($resp->content ne "");
+ok ($resp->header("Type") eq "SYNTAX");
+ok ($resp->header("Mess") eq "SYNTAX: Region, Zone or Rack field too big");
+
+$resp = GET "/mod_cluster_manager";
+ok $resp->is_success;
+ok (index($resp->as_string, "Node spare") == -1);
+
 END {
     remove_nodes 'spare';
     sleep 25;
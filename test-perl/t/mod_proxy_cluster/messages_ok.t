@@ -18,7 +18,7 @@ my $extra_tests = 0;
 my $version1 = (mpc_version())[0] == 1;
 $extra_tests = 9 if ($version1);
 
-plan tests => 203 + $extra_tests, need_mpc;
+plan tests => 206 + $extra_tests, need_mpc;
 
 my $resp = GET "/";
 ok $resp->is_success;
@@ -41,6 +41,12 @@ foreach my $jvmroute ('next', 'spare') {
     ok (index($resp->as_string, "Node $jvmroute") != -1);
 }
 
+# The JSON view lists both nodes
+$resp = GET "/mod_cluster_manager?Cmd=JSON";
+ok $resp->is_success;
+ok t_cmp($resp->header('Content-Type'), qr{^application/json});
+ok ($resp->content =~ /"name":"next".*"name":"spare"/s);
+
 ##################
 ##### STATUS #####
 ##################
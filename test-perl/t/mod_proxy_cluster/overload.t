@@ -0,0 +1,86 @@
+# Before 'make install' is performed this script should be runnable with
+# 'make test'. After 'make install' it should work as 'perl Apache-ModProxyCluster.t'
+#########################
+
+use strict;
+use warnings;
+
+use Apache::Test;
+use Apache::TestUtil;
+use Apache::TestConfig;
+use Apache::TestRequest 'GET';
+
+use Time::HiRes qw(time sleep);
+
+use ModProxyCluster;
+
+Apache::TestRequest::module("mpc_test_host");
+
+plan tests => 12, need_mpc;
+
+my ($pid, $start, $resp);
+
+#################################################
+### Wait queue: a saturated node frees a slot ###
+#################################################
+restart_with();
+
+ok add_app_node 'app1', 'fake_cgi_app', 100, WaitWorker => 5, Smax => 1;
+
+set_app 'fake_cgi_app', 'delay', 2;
+$pid = GET_background '/news';
+sleep 0.5;
+$start = time;
+$resp = GET '/news';
+ok t_cmp($resp->code, 200, "The request got app1 when the first one ended");
+ok t_cmp(time - $start >= 1 ? 1 : 0, 1, "The request waited for the first one to end");
+waitpid $pid, 0;
+set_app 'fake_cgi_app', 'delay';
+
+####################################################
+### ContextMaxRequests: the excess requests wait ###
+####################################################
+restart_with 'ContextMaxRequests 1';
+
+# WaitWorker gives a timeout to the balancer, the requests wait for the context up to 5 seconds
+ok add_app_node 'app1', 'fake_cgi_app', 100, WaitWorker => 5;
+
+set_app 'fake_cgi_app', 'delay', 2;
+$pid = GET_background '/news';
+sleep 0.5;
+$start = time;
+$resp = GET '/news';
+ok $resp->is_success;
+ok t_cmp(served_by($resp), 'fake_cgi_app', "The request waited for app1");
+ok t_cmp(time - $start >= 1 ? 1 : 0, 1, "The request waited for the first one to end");
+waitpid $pid, 0;
+set_app 'fake_cgi_app', 'delay';
+
+$resp = GET '/mod_cluster_manager';
+ok t_cmp($resp->content, qr/Waited: 1 /, "The manager page shows the waiting request");
+
+#######################################################
+### StandbyOverflow: the standby takes the overflow ###
+#######################################################
+restart_with 'StandbyOverflow Utilization=50';
+
+ok add_app_node 'app1', 'fake_cgi_app', 100, Smax => 2;
+ok add_app_node 'standby', 'fake_cgi_app2', 0;
+
+ok t_cmp(served_by(GET '/news'), 'fake_cgi_app', "The standby node is not used below the utilization");
+
+# One request in flight is 50% of the smax of app1
+set_app 'fake_cgi_app', 'delay', 3;
+$pid = GET_background '/news';
+sleep 1;
+ok t_cmp(served_by(GET '/news'), 'fake_cgi_app2', "The standby node gets the overflow");
+waitpid $pid, 0;
+set_app 'fake_cgi_app', 'delay';
+
+# Clean after yourself: restart without the directives of the test
+END {
+    my $ret = $?;
+    set_app 'fake_cgi_app', 'delay';
+    restart_with();
+    $? = $ret;
+}
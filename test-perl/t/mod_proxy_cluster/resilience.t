@@ -0,0 +1,84 @@
+# Before 'make install' is performed this script should be runnable with
+# 'make test'. After 'make install' it should work as 'perl Apache-ModProxyCluster.t'
+#########################
+
+use strict;
+use warnings;
+
+use Apache::Test;
+use Apache::TestUtil;
+use Apache::TestConfig;
+use Apache::TestRequest 'GET';
+
+use LWP::UserAgent;
+
+use ModProxyCluster;
+
+Apache::TestRequest::module("mpc_test_host");
+
+plan tests => 13, need_mpc;
+
+my (@codes, $resp);
+
+#####################################################
+### OutlierDetection: the failing node is ejected ###
+#####################################################
+restart_with 'OutlierDetection Consecutive=2 Ejection=60';
+
+ok add_app_node 'app1', 'fake_cgi_app';
+ok add_app_node 'app2', 'fake_cgi_app2';
+
+set_app 'fake_cgi_app2', 'fail', 1;
+@codes = map { (GET '/news')->code } 1..12;
+ok t_cmp(scalar(grep { $_ == 500 } @codes), qr/^[12]$/, "app2 is ejected after 2 failed requests (@codes)");
+ok t_cmp("@codes[6..11]", join(' ', (200) x 6), "The requests after the ejection succeed");
+set_app 'fake_cgi_app2', 'fail';
+
+#############################################################
+### CircuitBreakerTrials: a recovering node is tried once ###
+#############################################################
+restart_with 'CircuitBreakerTrials 1';
+
+ok add_app_node 'app1', 'fake_cgi_app';
+ok add_app_node 'app2', 'fake_cgi_app2';
+
+# The node goes in error and its circuit opens when a request wants it
+set_app 'fake_cgi_app2', 'fail', 1;
+$resp = CMD 'STATUS', { JVMRoute => 'app2', Load => -1 };
+ok $resp->is_success;
+# The retry of mod_proxy lets the sticky request through: it is the trial and it fails
+$resp = GET '/news', Cookie => 'JSESSIONID=circuit.app2';
+ok t_cmp($resp->code, 500, "The trial request of app2 fails");
+
+# The node says it is back, the open circuit lets one trial request through and it fails again
+$resp = CMD 'STATUS', { JVMRoute => 'app2', Load => 100 };
+ok $resp->is_success;
+@codes = map { (GET '/news')->code } 1..6;
+ok t_cmp(scalar(grep { $_ == 500 } @codes), qr/^[01]$/, "app2 gets at most one trial request (@codes)");
+set_app 'fake_cgi_app2', 'fail';
+
+###############################################
+### RetryBudget: an empty budget fails open ###
+###############################################
+restart_with 'RetryBudget 1';
+
+# The requests share the retry budget of one child when they use the same connection
+my $ua = LWP::UserAgent->new(keep_alive => 1);
+
+# 12 nodes that refuse the connections, a request can try all of them
+ok add_app_node 'app1', 'fake_cgi_app', 100, Maxattempts => 20;
+my $dead = grep { add_dead_node "dead$_", Maxattempts => 20 } 1..12;
+ok t_cmp($dead, 12, "The dead nodes are registered");
+
+# A new child has 10 failover attempts, 12 are needed before all the dead nodes are in error: the
+# attempts past the budget still fail over, they only don't wait for a worker
+@codes = map { $ua->get("$ModProxyCluster::ROOT/news")->code } 1..10;
+ok t_cmp("@codes", join(' ', (200) x 10), "The requests fail over even when the budget is exhausted");
+
+# Clean after yourself: restart without the directives of the test
+END {
+    my $ret = $?;
+    set_app 'fake_cgi_app2', 'fail';
+    restart_with();
+    $? = $ret;
+}